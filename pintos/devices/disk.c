@@ -3,13 +3,18 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the
+   controller is a PCI bus master, like the PIIX in QEMU, data
+   moves by DMA; otherwise it moves by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -31,7 +36,31 @@
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRDT address. */
+
+/* Bus master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Direction: 1=device to memory. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERR 0x02            /* Error (write 1 to clear). */
+#define BMS_INTR 0x04           /* Interrupt (write 1 to clear). */
+
+/* PCI configuration space ports and registers. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_COMMAND 0x04    /* Command (low 16 bits). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, prog IF, revision. */
+#define PCI_REG_BAR4 0x20       /* Bus master IDE base for IDE. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +76,50 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor.  The bus master walks a table
+   of these to find the memory for a DMA transfer.  A region
+   must not cross a 64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Byte count; 0 means 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the table's last entry. */
+};
+#define PRD_EOT 0x8000
+
+/* Descriptors per table.  A merged command whose buffers need
+   more than this goes by PIO instead. */
+#define PRD_CNT 32
+
+struct channel;
+
+/* An I/O scheduler.  Decides the order in which the requests
+   queued on a channel go to its disks, merging requests for
+   adjacent sectors into one command along the way.  Called with
+   interrupts off. */
+struct disk_scheduler {
+	const char *name;           /* Name for disk_set_scheduler(). */
+
+	/* Queues request R on channel C. */
+	void (*add) (struct channel *c, struct disk_request *r);
+
+	/* Removes and returns the head of the next command to issue
+	   on channel C, or returns NULL if C has nothing queued. */
+	struct disk_request *(*next) (struct channel *c);
+};
+
+/* Deadline scheduler tuning. */
+#define READ_EXPIRE 500000     /* Microseconds a read may wait. */
+#define WRITE_EXPIRE 5000000   /* Microseconds a write may wait. */
+#define DEADLINE_BATCH 16       /* Commands per sweep between checks
+								   of the oldest request. */
+#define WRITES_STARVED 2        /* Read batches that may pass over
+								   waiting writes. */
 
 /* An ATA device. */
 struct disk {
@@ -56,9 +129,20 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	size_t multiple;            /* Sectors per READ/WRITE MULTIPLE
+								   block, or 0 if not in use. */
+	bool dma;                   /* Disk supports DMA. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+
+	/* Statistics.  Times are in microseconds. */
+	enum disk_origin origin;    /* Default origin of requests. */
+	struct disk_stats stats[DISK_ORIGIN_CNT];
+	int depth;                  /* Requests queued or active now. */
+	int max_depth;              /* Maximum of DEPTH. */
+	uint64_t depth_area;        /* DEPTH integrated over time. */
+	uint64_t depth_since;       /* Time DEPTH last changed. */
 };
 
 /* An ATA channel (aka controller).
@@ -68,10 +152,51 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
-	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+	struct semaphore completion_wait;   /* Up'd by interrupt handler
+										   for commands outside the queue. */
+
+	/* Request queue.  Only touched with interrupts off.
+	   Queues are indexed by a request's WRITE member. */
+	struct list queue;          /* Noop: queued requests, in order. */
+	struct list sorted[2];      /* Deadline: queued reads and writes,
+								   in disk position order. */
+	struct list fifo[2];        /* Deadline: the same, oldest first. */
+	bool dir;                   /* Deadline: direction of the batch. */
+	int batch;                  /* Deadline: commands in the batch. */
+	int starved;                /* Deadline: read batches issued while
+								   writes waited. */
+	struct disk *pos_disk;      /* Disk and sector just past the last */
+	disk_sector_t pos_sec;      /* command issued; NULL disk if none. */
+
+	struct disk_request *active;    /* Head of the command on the wire,
+									   or NULL. */
+	struct disk_request *cur;   /* Request within the active command
+								   that PIO has reached. */
+	size_t cur_xfer;            /* Sectors of CUR transferred. */
+
+	/* Statistics. */
+	long long requests;         /* Requests submitted. */
+	long long merges;           /* Requests merged into a command. */
+	long long commands;         /* Commands issued. */
+	int depth;                  /* Requests queued or active now. */
+	int max_depth;              /* Maximum of DEPTH. */
+	long long depth_sum;        /* DEPTH as seen by each arrival, summed. */
+	uint64_t latency_sum;       /* Microseconds from submission to
+								   completion, summed over requests. */
+	uint64_t max_latency;       /* Maximum of the same. */
+	uint64_t issued;            /* Time the active command was issued. */
+
+	/* Fallback bounce buffer for disk_transfer(). */
+	struct lock bounce_lock;    /* Protects BOUNCE. */
+	uint8_t bounce[DISK_SECTOR_SIZE];
+
+	/* Bus master DMA. */
+	uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+	bool dma_active;            /* Active request is using DMA. */
+	struct prd prdt[PRD_CNT]    /* Physical region descriptor table. */
+		__attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
 
 	struct disk devices[2];     /* The devices on this channel. */
 };
@@ -80,11 +205,34 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+static void noop_add (struct channel *, struct disk_request *);
+static struct disk_request *noop_next (struct channel *);
+static void deadline_add (struct channel *, struct disk_request *);
+static struct disk_request *deadline_next (struct channel *);
+
+static const struct disk_scheduler noop_scheduler = {
+	"noop", noop_add, noop_next,
+};
+
+static const struct disk_scheduler deadline_scheduler = {
+	"deadline", deadline_add, deadline_next,
+};
+
+/* Available schedulers. */
+static const struct disk_scheduler *const schedulers[] = {
+	&deadline_scheduler, &noop_scheduler,
+};
+
+/* Scheduler used by every channel. */
+static const struct disk_scheduler *scheduler = &deadline_scheduler;
+
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
+static void set_multiple_mode (struct disk *, size_t);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -94,13 +242,40 @@ static bool wait_while_busy (const struct disk *);
 static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
+static bool merge_request (struct channel *, struct list *, bool fifo,
+		struct disk_request *);
+static void start_request (struct channel *);
+static void continue_request (struct channel *);
+static bool continue_pio (struct channel *, struct disk_request *);
+static size_t block_size (const struct disk_request *);
+static void transfer_block (struct channel *, struct disk_request *);
+static bool build_prdt (struct channel *, const struct disk_request *);
+static void start_dma (struct channel *, struct disk_request *);
+static bool finish_dma (struct channel *, struct disk_request *);
+static bool wait_for_drq (const struct disk *);
+
 static void interrupt_handler (struct intr_frame *);
 
+static void depth_change (struct disk *, int delta);
+static void account_request (const struct disk_request *,
+		uint64_t issued, uint64_t now);
+
+/* Time at which statistics collection began. */
+static uint64_t stats_start;
+
+/* Names of origins, for printing. */
+static const char *const origin_names[DISK_ORIGIN_CNT] = {
+	"filesys", "swap", "scratch", "other",
+};
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = find_bus_master ();
 	size_t chan_no;
 
+	stats_start = timer_usec ();
+
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
 		struct channel *c = &channels[chan_no];
 		int dev_no;
@@ -119,9 +294,24 @@ disk_init (void) {
 			default:
 				NOT_REACHED ();
 		}
-		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		lock_init (&c->bounce_lock);
+		list_init (&c->queue);
+		list_init (&c->sorted[0]);
+		list_init (&c->sorted[1]);
+		list_init (&c->fifo[0]);
+		list_init (&c->fifo[1]);
+		c->dir = false;
+		c->batch = c->starved = 0;
+		c->pos_disk = NULL;
+		c->pos_sec = 0;
+		c->active = c->cur = NULL;
+		c->requests = c->merges = c->commands = 0;
+		c->depth = c->max_depth = 0;
+		c->depth_sum = c->latency_sum = c->max_latency = 0;
+		c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+		c->dma_active = false;
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,8 +322,22 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->multiple = 0;
+			d->dma = false;
 
 			d->read_cnt = d->write_cnt = 0;
+			/* Guess the origin from the disk's usual role, for
+			   callers that do not pass one to disk_transfer(). */
+			if (chan_no == 0 && dev_no == 1)
+				d->origin = DISK_ORIGIN_FILESYS;
+			else if (chan_no == 1)
+				d->origin = dev_no == 0 ? DISK_ORIGIN_SCRATCH : DISK_ORIGIN_SWAP;
+			else
+				d->origin = DISK_ORIGIN_OTHER;
+			memset (d->stats, 0, sizeof d->stats);
+			d->depth = d->max_depth = 0;
+			d->depth_area = 0;
+			d->depth_since = stats_start;
 		}
 
 		/* Register interrupt handler. */
@@ -156,6 +360,39 @@ disk_init (void) {
 	register_disk_inspect_intr ();
 }
 
+/* Returns disk D's queue depth averaged over time since boot,
+   times 100. */
+static long long
+average_depth (struct disk *d) {
+	uint64_t now = timer_usec ();
+	uint64_t area = d->depth_area + (uint64_t) d->depth * (now - d->depth_since);
+
+	return now > stats_start ? area * 100 / (now - stats_start) : 0;
+}
+
+/* Prints histogram HIST of CNT buckets for disk D and origin
+   ORIGIN, labeled LABEL, with UNIT after each range.  Omits empty
+   buckets. */
+static void
+print_histogram (const struct disk *d, enum disk_origin origin,
+		const char *label, const long long *hist, int cnt,
+		const char *unit) {
+	int i;
+
+	printf ("%s %s: %s", d->name, origin_names[origin], label);
+	for (i = 0; i < cnt; i++)
+		if (hist[i] != 0) {
+			if (i == cnt - 1)
+				printf (" %lld+%s:%lld", 1LL << i, unit, hist[i]);
+			else if (i == 0)
+				printf (" 0-1%s:%lld", unit, hist[i]);
+			else
+				printf (" %lld-%lld%s:%lld",
+						1LL << i, (1LL << (i + 1)) - 1, unit, hist[i]);
+		}
+	printf ("\n");
+}
+
 /* Prints disk statistics. */
 void
 disk_print_stats (void) {
@@ -166,11 +403,50 @@ disk_print_stats (void) {
 
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
-			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+			long long depth;
+			int origin;
+
+			if (d == NULL || !d->is_ata)
+				continue;
+			printf ("%s: %lld reads, %lld writes\n",
+					d->name, d->read_cnt, d->write_cnt);
+			if (d->max_depth == 0)
+				continue;
+
+			depth = average_depth (d);
+			printf ("%s: queue depth avg %lld.%02lld max %d\n",
+					d->name, depth / 100, depth % 100, d->max_depth);
+			for (origin = 0; origin < DISK_ORIGIN_CNT; origin++) {
+				const struct disk_stats *st = &d->stats[origin];
+
+				if (st->requests == 0)
+					continue;
+				printf ("%s %s: %lld requests, %lld bytes, "
+						"avg wait %lld us, avg service %lld us\n",
+						d->name, origin_names[origin], st->requests, st->bytes,
+						st->wait_us / st->requests, st->service_us / st->requests);
+				print_histogram (d, origin, "sectors", st->size_hist,
+						DISK_SIZE_BUCKETS, "");
+				print_histogram (d, origin, "service", st->time_hist,
+						DISK_TIME_BUCKETS, "us");
+			}
 		}
 	}
+
+	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+		struct channel *c = &channels[chan_no];
+
+		if (c->requests == 0)
+			continue;
+		printf ("%s: %s scheduler, %lld requests in %lld commands "
+				"(%lld merged)\n",
+				c->name, scheduler->name, c->requests, c->commands, c->merges);
+		printf ("%s: queue depth avg %lld max %d, "
+				"latency avg %lld max %lld us\n",
+				c->name, c->depth_sum / c->requests, c->max_depth,
+				(long long) (c->latency_sum / c->requests),
+				(long long) c->max_latency);
+	}
 }
 
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
@@ -203,27 +479,146 @@ disk_size (struct disk *d) {
 	return d->capacity;
 }
 
+/* Initializes R as a request to read (or, if WRITE, to write)
+   the CNT sectors of disk D starting at SEC_NO from BUFFER,
+   calling DONE when it is complete. */
+void
+disk_request_init (struct disk_request *r, struct disk *d,
+		disk_sector_t sec_no, size_t cnt, void *buffer, bool write,
+		disk_done_func *done, void *aux) {
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (sec_no < d->capacity && cnt <= d->capacity - sec_no);
+
+	r->disk = d;
+	r->sec_no = sec_no;
+	r->cnt = cnt;
+	r->buffer = buffer;
+	r->write = write;
+	r->done = done;
+	r->aux = aux;
+	r->origin = d->origin;
+}
+
+/* Copies disk D's statistics for requests from ORIGIN into
+   *STATS. */
+void
+disk_get_stats (struct disk *d, enum disk_origin origin,
+		struct disk_stats *stats) {
+	enum intr_level old_level;
+
+	ASSERT (d != NULL);
+	ASSERT (origin < DISK_ORIGIN_CNT);
+
+	old_level = intr_disable ();
+	*stats = d->stats[origin];
+	intr_set_level (old_level);
+}
+
+/* Queues request R on its disk's channel and returns without
+   waiting.  The channel's I/O scheduler picks the order in which
+   queued requests are issued, one command at a time, each
+   started from the interrupt handler of the one before.  Calls
+   R->done from the interrupt handler once R is complete.
+   R->buffer is accessed from interrupt context, so it must be
+   kernel memory. */
+void
+disk_submit (struct disk_request *r) {
+	struct channel *c = r->disk->channel;
+	enum intr_level old_level;
+
+	ASSERT (is_kernel_vaddr (r->buffer));
+
+	old_level = intr_disable ();
+	r->submitted = timer_usec ();
+	r->next = NULL;
+	r->run_cnt = r->cnt;
+	depth_change (r->disk, 1);
+
+	c->requests++;
+	c->depth++;
+	c->depth_sum += c->depth;
+	if (c->depth > c->max_depth)
+		c->max_depth = c->depth;
+
+	scheduler->add (c, r);
+	start_request (c);
+	intr_set_level (old_level);
+}
+
+/* Completion callback for the synchronous calls below. */
+static void
+wake_waiter (struct disk_request *r) {
+	sema_up (r->aux);
+}
+
+/* Transfers the CNT sectors of disk D starting at SEC_NO to or
+   from BUFFER and waits for the transfer to complete, counting
+   it under ORIGIN in D's statistics.  Runs longer than
+   DISK_MAX_SECTORS are split into several requests.  Buffers in
+   user memory go through a bounce buffer, since the transfer may
+   happen while another process's page tables are active.  If
+   there is no memory for one, the transfer goes a sector at a
+   time through the channel's own. */
+void
+disk_transfer (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer, bool write, enum disk_origin origin) {
+	uint8_t *p = buffer;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	while (cnt > 0) {
+		size_t n = cnt < DISK_MAX_SECTORS ? cnt : DISK_MAX_SECTORS;
+		size_t size = n * DISK_SECTOR_SIZE;
+		struct disk_request r;
+		struct semaphore done;
+		struct lock *bounce_lock = NULL;
+		void *bounce = NULL;
+
+		if (!is_kernel_vaddr (p)) {
+			bounce = malloc (size);
+			if (bounce == NULL) {
+				n = 1;
+				size = DISK_SECTOR_SIZE;
+				bounce_lock = &d->channel->bounce_lock;
+				lock_acquire (bounce_lock);
+				bounce = d->channel->bounce;
+			}
+			if (write)
+				memcpy (bounce, p, size);
+		}
+
+		sema_init (&done, 0);
+		disk_request_init (&r, d, sec_no, n, bounce != NULL ? bounce : p,
+				write, wake_waiter, &done);
+		r.origin = origin;
+		disk_submit (&r);
+		sema_down (&done);
+
+		if (bounce != NULL) {
+			if (!write)
+				memcpy (p, bounce, size);
+			if (bounce_lock != NULL)
+				lock_release (bounce_lock);
+			else
+				free (bounce);
+		}
+
+		sec_no += n;
+		cnt -= n;
+		p += size;
+	}
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for DISK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_transfer (d, sec_no, 1, buffer, false, d->origin);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,25 +628,481 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	disk_transfer (d, sec_no, 1, (void *) buffer, true, d->origin);
+}
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  The disk moves the whole run with as few commands and
+   interrupts as it can, which is much cheaper than CNT calls to
+   disk_read(). */
+void
+disk_read_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
+	disk_transfer (d, sec_no, cnt, buffer, false, d->origin);
+}
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data. */
+void
+disk_write_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	disk_transfer (d, sec_no, cnt, (void *) buffer, true,
+			d->origin);
 }
-
+
+/* I/O schedulers. */
+
+/* Tries to merge request R into a command queued in LIST, whose
+   elements are the commands' head requests.  R joins the end of
+   a command that ends just before it, or becomes the new head of
+   a command that starts just after it, taking over the old
+   head's place in LIST and, if FIFO is true, in the FIFO as
+   well.  Returns true if R was merged. */
+static bool
+merge_request (struct channel *c, struct list *list, bool fifo,
+		struct disk_request *r) {
+	struct list_elem *e;
+
+	for (e = list_begin (list); e != list_end (list); e = list_next (e)) {
+		struct disk_request *q = list_entry (e, struct disk_request, elem);
+
+		if (q->disk != r->disk || q->write != r->write
+				|| q->run_cnt + r->cnt > DISK_MAX_SECTORS)
+			continue;
+
+		if (q->sec_no + q->run_cnt == r->sec_no) {
+			struct disk_request *tail = q;
+
+			while (tail->next != NULL)
+				tail = tail->next;
+			tail->next = r;
+			q->run_cnt += r->cnt;
+		} else if (r->sec_no + r->cnt == q->sec_no) {
+			r->next = q;
+			r->run_cnt = r->cnt + q->run_cnt;
+			r->deadline = q->deadline;
+			list_insert (&q->elem, &r->elem);
+			list_remove (&q->elem);
+			if (fifo) {
+				list_insert (&q->fifo_elem, &r->fifo_elem);
+				list_remove (&q->fifo_elem);
+			}
+		} else
+			continue;
+
+		c->merges++;
+		return true;
+	}
+	return false;
+}
+
+/* The noop scheduler issues commands in arrival order.  It only
+   merges. */
+
+static void
+noop_add (struct channel *c, struct disk_request *r) {
+	if (!merge_request (c, &c->queue, false, r))
+		list_push_back (&c->queue, &r->elem);
+}
+
+static struct disk_request *
+noop_next (struct channel *c) {
+	if (list_empty (&c->queue))
+		return NULL;
+	return list_entry (list_pop_front (&c->queue), struct disk_request, elem);
+}
+
+/* The deadline scheduler keeps reads and writes in separate
+   queues sorted by disk position and sweeps across one of them
+   in ascending order, a batch of commands at a time, so that the
+   disk head moves in one direction.  Reads are favored, since
+   their submitters are waiting, but writes get a batch after
+   WRITES_STARVED read batches.  Each request also has a
+   deadline; a batch that finds the oldest request in its
+   direction past due starts there instead of at the head. */
+
+/* Returns true if sector A_SEC of disk A comes before sector
+   B_SEC of disk B, ordering disks by device number. */
+static bool
+position_less (const struct disk *a, disk_sector_t a_sec,
+		const struct disk *b, disk_sector_t b_sec) {
+	if (a != b)
+		return a->dev_no < b->dev_no;
+	return a_sec < b_sec;
+}
+
+static void
+deadline_add (struct channel *c, struct disk_request *r) {
+	struct list *sorted = &c->sorted[r->write];
+	struct list_elem *e;
+
+	r->deadline = r->submitted + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+	if (merge_request (c, sorted, true, r))
+		return;
+
+	for (e = list_begin (sorted); e != list_end (sorted); e = list_next (e)) {
+		struct disk_request *q = list_entry (e, struct disk_request, elem);
+		if (position_less (r->disk, r->sec_no, q->disk, q->sec_no))
+			break;
+	}
+	list_insert (e, &r->elem);
+	list_push_back (&c->fifo[r->write], &r->fifo_elem);
+}
+
+/* Returns the first command in channel C's queue for direction
+   WRITE at or after the disk position reached by the last
+   command, or NULL if there is none. */
+static struct disk_request *
+sweep_next (struct channel *c, bool write) {
+	struct list *sorted = &c->sorted[write];
+	struct list_elem *e;
+
+	for (e = list_begin (sorted); e != list_end (sorted); e = list_next (e)) {
+		struct disk_request *q = list_entry (e, struct disk_request, elem);
+		if (c->pos_disk == NULL
+				|| !position_less (q->disk, q->sec_no, c->pos_disk, c->pos_sec))
+			return q;
+	}
+	return NULL;
+}
+
+static struct disk_request *
+deadline_next (struct channel *c) {
+	struct list *reads = &c->sorted[false], *writes = &c->sorted[true];
+	struct disk_request *r = NULL;
+
+	if (list_empty (reads) && list_empty (writes))
+		return NULL;
+
+	if (c->batch < DEADLINE_BATCH)
+		r = sweep_next (c, c->dir);
+	if (r == NULL) {
+		/* Start a new batch. */
+		struct disk_request *oldest;
+
+		if (!list_empty (reads)
+				&& (list_empty (writes) || c->starved < WRITES_STARVED)) {
+			c->dir = false;
+			if (!list_empty (writes))
+				c->starved++;
+		} else {
+			c->dir = true;
+			c->starved = 0;
+		}
+		c->batch = 0;
+
+		/* Continue the sweep from the last command, unless the
+		   oldest request is past due or the sweep has reached
+		   the end, and then start from the oldest request. */
+		oldest = list_entry (list_front (&c->fifo[c->dir]),
+				struct disk_request, fifo_elem);
+		if (timer_usec () >= oldest->deadline
+				|| (r = sweep_next (c, c->dir)) == NULL)
+			r = oldest;
+	}
+
+	c->batch++;
+	list_remove (&r->elem);
+	list_remove (&r->fifo_elem);
+	return r;
+}
+
+/* Selects the I/O scheduler called NAME, either "deadline" (the
+   default) or "noop".  Must be called before disk_init().
+   Returns false if there is no such scheduler. */
+bool
+disk_set_scheduler (const char *name) {
+	size_t i;
+
+	for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+		if (name != NULL && !strcmp (name, schedulers[i]->name)) {
+			scheduler = schedulers[i];
+			return true;
+		}
+	return false;
+}
+
+/* If channel C is idle, issues the next command chosen by the
+   I/O scheduler.  A command covers its head request and any
+   requests merged into it.  Called with interrupts off, from
+   thread or interrupt context.
+
+   If the channel and disk can do DMA, the bus master moves the
+   data and the disk interrupts once, when the whole command is
+   done.  Otherwise the data moves by PIO, and the first block of
+   a write is sent here.  A PIO command for several sectors uses
+   READ/WRITE MULTIPLE if the disk supports it, so that each
+   interrupt moves a block of sectors, and READ/WRITE SECTOR with
+   a sector count otherwise, which interrupts once per sector. */
+static void
+start_request (struct channel *c) {
+	struct disk_request *r;
+	uint8_t command;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (c->active != NULL || (r = scheduler->next (c)) == NULL)
+		return;
+
+	c->active = c->cur = r;
+	c->cur_xfer = 0;
+	c->pos_disk = r->disk;
+	c->pos_sec = r->sec_no + r->run_cnt;
+	c->commands++;
+	c->issued = timer_usec ();
+	r->xfer = 0;
+	c->dma_active = build_prdt (c, r);
+	if (c->dma_active) {
+		start_dma (c, r);
+		return;
+	}
+
+	if (block_size (r) > 1)
+		command = r->write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+	else
+		command = r->write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+
+	select_sector (r->disk, r->sec_no, r->run_cnt);
+	c->expecting_interrupt = true;
+	outb (reg_command (c), command);
+	if (r->write) {
+		if (!wait_for_drq (r->disk))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu,
+					r->disk->name, r->sec_no);
+		transfer_block (c, r);
+	}
+}
+
+/* Handles an interrupt for channel C's active command.  When the
+   command is complete, starts the next one so the disk stays
+   busy, and then notifies the submitters of the requests in it. */
+static void
+continue_request (struct channel *c) {
+	struct disk_request *r = c->active;
+	uint64_t issued = c->issued;
+	uint64_t now;
+
+	if (!(c->dma_active ? finish_dma (c, r) : continue_pio (c, r)))
+		return;
+
+	c->active = c->cur = NULL;
+	c->dma_active = false;
+	c->expecting_interrupt = false;
+	start_request (c);
+
+	now = timer_usec ();
+	while (r != NULL) {
+		struct disk_request *next = r->next;
+		uint64_t latency = now - r->submitted;
+
+		c->depth--;
+		c->latency_sum += latency;
+		if (latency > c->max_latency)
+			c->max_latency = latency;
+		account_request (r, issued, now);
+		depth_change (r->disk, -1);
+		r->done (r);
+		r = next;
+	}
+}
+
+/* Handles an interrupt for PIO request R on channel C.  The disk
+   interrupts once per block: for a read, when the block is ready
+   to be read in; for a write, when it has taken the block just
+   sent and wants the next one, and once more at the end.
+   Returns true once R is complete. */
+static bool
+continue_pio (struct channel *c, struct disk_request *r) {
+	struct disk *d = r->disk;
+	disk_sector_t sec_no = r->sec_no + r->xfer;
+	uint8_t status = inb (reg_status (c));      /* Acknowledge interrupt. */
+
+	if (status & (STA_ERR | STA_DF))
+		PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+				d->name, r->write ? "write" : "read", sec_no);
+	if (r->write && r->xfer == r->run_cnt)
+		return true;
+
+	if (!(status & STA_DRQ))
+		PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+				d->name, r->write ? "write" : "read", sec_no);
+	transfer_block (c, r);
+	return !r->write && r->xfer == r->run_cnt;
+}
+
+/* Returns the number of sectors the disk moves per interrupt
+   for the command headed by R. */
+static size_t
+block_size (const struct disk_request *r) {
+	return r->run_cnt > 1 && r->disk->multiple > 1 ? r->disk->multiple : 1;
+}
+
+/* Moves the next block of the command headed by R, or whatever
+   is left of it if that is less, between the requests' buffers
+   and channel C's data register. */
+static void
+transfer_block (struct channel *c, struct disk_request *r) {
+	struct disk *d = r->disk;
+	size_t n = block_size (r);
+	size_t i;
+
+	if (n > r->run_cnt - r->xfer)
+		n = r->run_cnt - r->xfer;
+	for (i = 0; i < n; i++) {
+		uint8_t *p;
+
+		if (c->cur_xfer == c->cur->cnt) {
+			c->cur = c->cur->next;
+			c->cur_xfer = 0;
+		}
+		p = (uint8_t *) c->cur->buffer + c->cur_xfer++ * DISK_SECTOR_SIZE;
+		if (r->write)
+			output_sector (c, p);
+		else
+			input_sector (c, p);
+	}
+
+	r->xfer += n;
+	if (r->write)
+		d->write_cnt += n;
+	else
+		d->read_cnt += n;
+}
+
+/* Fills in channel C's physical region descriptor table for the
+   command headed by R, with one or more regions per request.
+   Returns false, leaving the command to PIO, if C or the disk
+   cannot do DMA, a buffer is not addressable by the bus master,
+   or the table is too small. */
+static bool
+build_prdt (struct channel *c, const struct disk_request *r) {
+	struct prd *prd = c->prdt;
+	const struct disk_request *q;
+
+	if (c->bm_base == 0 || !r->disk->dma)
+		return false;
+
+	for (q = r; q != NULL; q = q->next) {
+		uint64_t addr = vtop (q->buffer);
+		size_t left = q->cnt * DISK_SECTOR_SIZE;
+
+		if (addr % 2 != 0 || addr + left > 0x100000000ULL)
+			return false;
+		while (left > 0) {
+			size_t size = 0x10000 - addr % 0x10000;
+			if (size > left)
+				size = left;
+
+			if (prd == c->prdt + PRD_CNT)
+				return false;
+			prd->addr = addr;
+			prd->size = size;           /* 64 kB truncates to 0. */
+			prd->flags = 0;
+			prd++;
+			addr += size;
+			left -= size;
+		}
+	}
+	prd[-1].flags = PRD_EOT;
+	return true;
+}
+
+/* Issues request R on channel C as a DMA transfer described by
+   C's physical region descriptor table. */
+static void
+start_dma (struct channel *c, struct disk_request *r) {
+	uint8_t direction = r->write ? 0 : BM_READ;
+
+	outb (reg_bm_command (c), direction);
+	outb (reg_bm_status (c), BMS_ERR | BMS_INTR);
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+
+	select_sector (r->disk, r->sec_no, r->run_cnt);
+	c->expecting_interrupt = true;
+	outb (reg_command (c), r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), direction | BM_START);
+}
+
+/* Handles an interrupt for DMA request R on channel C.  Returns
+   false if the bus master has not finished yet, true once R is
+   complete. */
+static bool
+finish_dma (struct channel *c, struct disk_request *r) {
+	struct disk *d = r->disk;
+	uint8_t bm_status = inb (reg_bm_status (c));
+	uint8_t status = inb (reg_status (c));      /* Acknowledge interrupt. */
+
+	if (!(bm_status & (BMS_INTR | BMS_ERR)))
+		return false;
+
+	outb (reg_bm_command (c), 0);
+	outb (reg_bm_status (c), BMS_ERR | BMS_INTR);
+	if ((bm_status & BMS_ERR) || (status & (STA_ERR | STA_DF)))
+		PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+				d->name, r->write ? "write" : "read", r->sec_no);
+
+	r->xfer = r->run_cnt;
+	if (r->write)
+		d->write_cnt += r->run_cnt;
+	else
+		d->read_cnt += r->run_cnt;
+	return true;
+}
+
 /* Disk detection and identification. */
 
+/* Reads the 32-bit register at offset REG of the configuration
+   space of PCI function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG of the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, enables bus mastering on it, and returns the base port
+   of its bus master registers.  Returns 0 if there is none. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class, bar, command;
+
+			if (pci_read_config (dev, func, 0) == 0xffffffff)
+				continue;           /* No such function. */
+			class = pci_read_config (dev, func, PCI_REG_CLASS);
+			/* Class 1 (mass storage), subclass 1 (IDE), with
+			   prog IF bit 7 set for bus mastering. */
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+			bar = pci_read_config (dev, func, PCI_REG_BAR4);
+			if (!(bar & 1) || (bar & 0xfffc) == 0)
+				continue;
+
+			/* The upper half is the status register, whose bits
+			   are cleared by writing 1s, so write back 0s. */
+			command = pci_read_config (dev, func, PCI_REG_COMMAND) & 0xffff;
+			pci_write_config (dev, func, PCI_REG_COMMAND,
+					command | PCI_CMD_IO | PCI_CMD_MASTER);
+			return bar & 0xfffc;
+		}
+	return 0;
+}
+
 static void print_ata_string (char *string, size_t size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -380,6 +1231,29 @@ identify_ata_device (struct disk *d) {
 	printf ("\", serial \"");
 	print_ata_string ((char *) &id[10], 20);
 	printf ("\"\n");
+
+	/* Bit 8 of word 49 says whether the disk supports DMA. */
+	d->dma = (id[49] & 0x0100) != 0;
+
+	/* The low byte of word 47 is the most sectors the disk will
+	   move per interrupt with READ/WRITE MULTIPLE. */
+	if ((id[47] & 0xff) > 1)
+		set_multiple_mode (d, id[47] & 0xff);
+}
+
+/* Sets disk D's READ/WRITE MULTIPLE block size to CNT sectors.
+   Leaves D using single-sector blocks if the disk refuses. */
+static void
+set_multiple_mode (struct disk *d, size_t cnt) {
+	struct channel *c = d->channel;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), cnt);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if (!(inb (reg_status (c)) & (STA_ERR | STA_DF)))
+		d->multiple = cnt;
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -402,17 +1276,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and count
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
 	ASSERT (sec_no < d->capacity);
 	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -448,8 +1323,10 @@ output_sector (struct channel *c, const void *sector) {
 
 /* Low-level ATA primitives. */
 
-/* Wait up to 10 seconds for the controller to become idle, that
-   is, for the BSY and DRQ bits to clear in the status register.
+/* Wait up to 10 milliseconds for the controller to become idle,
+   that is, for the BSY and DRQ bits to clear in the status
+   register.  Busy-waits, so it may be called from the interrupt
+   handler.
 
    As a side effect, reading the status register clears any
    pending interrupt. */
@@ -460,7 +1337,7 @@ wait_until_idle (const struct disk *d) {
 	for (i = 0; i < 1000; i++) {
 		if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
 			return;
-		timer_usleep (10);
+		timer_udelay (10);
 	}
 
 	printf ("%s: idle timeout\n", d->name);
@@ -490,6 +1367,24 @@ wait_while_busy (const struct disk *d) {
 	return false;
 }
 
+/* Busy-waits up to a second for disk D to clear BSY after a
+   write command, and then returns the status of the DRQ bit.
+   Unlike wait_while_busy(), may be called from the interrupt
+   handler. */
+static bool
+wait_for_drq (const struct disk *d) {
+	struct channel *c = d->channel;
+	int i;
+
+	for (i = 0; i < 100000; i++) {
+		uint8_t status = inb (reg_alt_status (c));
+		if (!(status & STA_BSY))
+			return (status & STA_DRQ) != 0;
+		timer_udelay (10);
+	}
+	return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct disk *d) {
@@ -499,7 +1394,7 @@ select_device (const struct disk *d) {
 		dev |= DEV_DEV;
 	outb (reg_device (c), dev);
 	inb (reg_alt_status (c));
-	timer_nsleep (400);
+	timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -518,7 +1413,9 @@ interrupt_handler (struct intr_frame *f) {
 
 	for (c = channels; c < channels + CHANNEL_CNT; c++)
 		if (f->vec_no == c->irq) {
-			if (c->expecting_interrupt) {
+			if (c->active != NULL)
+				continue_request (c);
+			else if (c->expecting_interrupt) {
 				inb (reg_status (c));               /* Acknowledge interrupt. */
 				sema_up (&c->completion_wait);      /* Wake up waiter. */
 			} else
@@ -529,6 +1426,48 @@ interrupt_handler (struct intr_frame *f) {
 	NOT_REACHED ();
 }
 
+/* Statistics. */
+
+/* Adds DELTA to disk D's queue depth. */
+static void
+depth_change (struct disk *d, int delta) {
+	uint64_t now = timer_usec ();
+
+	d->depth_area += (uint64_t) d->depth * (now - d->depth_since);
+	d->depth_since = now;
+	d->depth += delta;
+	if (d->depth > d->max_depth)
+		d->max_depth = d->depth;
+}
+
+/* Returns the histogram bucket for X among CNT buckets: the
+   base-2 logarithm of X, rounded down and capped at CNT - 1. */
+static int
+bucket (uint64_t x, int cnt) {
+	int i = 0;
+
+	while (x > 1 && i < cnt - 1) {
+		x >>= 1;
+		i++;
+	}
+	return i;
+}
+
+/* Accounts for completed request R, whose command was issued at
+   time ISSUED and finished at time NOW. */
+static void
+account_request (const struct disk_request *r, uint64_t issued,
+		uint64_t now) {
+	struct disk_stats *st = &r->disk->stats[r->origin];
+
+	st->requests++;
+	st->bytes += r->cnt * DISK_SECTOR_SIZE;
+	st->wait_us += issued - r->submitted;
+	st->service_us += now - issued;
+	st->size_hist[bucket (r->cnt, DISK_SIZE_BUCKETS)]++;
+	st->time_hist[bucket (now - issued, DISK_TIME_BUCKETS)]++;
+}
+
 static void
 inspect_read_cnt (struct intr_frame *f) {
 	struct disk * d = disk_get (f->R.rdx, f->R.rcx);
@@ -541,14 +1480,55 @@ inspect_write_cnt (struct intr_frame *f) {
 	f->R.rax = d->write_cnt;
 }
 
+static void
+inspect_stats (struct intr_frame *f) {
+	struct disk *d = disk_get (f->R.rdx, f->R.rcx);
+	uint64_t origin = f->R.rsi;
+	uint64_t field = f->R.rdi;
+	const struct disk_stats *st;
+
+	if (d == NULL || origin >= DISK_ORIGIN_CNT || field >= DISK_STAT_FIELD_CNT) {
+		f->R.rax = -1;
+		return;
+	}
+
+	st = &d->stats[origin];
+	if (field >= DISK_STAT_DEPTH_MAX)
+		f->R.rax = d->max_depth;
+	else if (field >= DISK_STAT_DEPTH_AVG)
+		f->R.rax = average_depth (d);
+	else if (field >= DISK_STAT_TIME_HIST)
+		f->R.rax = st->time_hist[field - DISK_STAT_TIME_HIST];
+	else if (field >= DISK_STAT_SIZE_HIST)
+		f->R.rax = st->size_hist[field - DISK_STAT_SIZE_HIST];
+	else if (field == DISK_STAT_SERVICE_US)
+		f->R.rax = st->service_us;
+	else if (field == DISK_STAT_WAIT_US)
+		f->R.rax = st->wait_us;
+	else if (field == DISK_STAT_BYTES)
+		f->R.rax = st->bytes;
+	else
+		f->R.rax = st->requests;
+}
+
 /* Tool for testing disk r/w cnt. Calling this function via int 0x43 and int 0x44.
  * Input:
  *   @RDX - chan_no of disk to inspect
  *   @RCX - dev_no of disk to inspect
  * Output:
- *   @RAX - Read/Write count of disk. */
+ *   @RAX - Read/Write count of disk.
+ *
+ * Int 0x45 reads a disk's statistics.
+ * Input:
+ *   @RDX - chan_no of disk to inspect
+ *   @RCX - dev_no of disk to inspect
+ *   @RSI - enum disk_origin
+ *   @RDI - enum disk_stat_field
+ * Output:
+ *   @RAX - Value of the field, or -1 if an input is invalid. */
 void
 register_disk_inspect_intr (void) {
 	intr_register_int (0x43, 3, INTR_OFF, inspect_read_cnt, "Inspect Disk Read Count");
 	intr_register_int (0x44, 3, INTR_OFF, inspect_write_cnt, "Inspect Disk Write Count");
+	intr_register_int (0x45, 3, INTR_OFF, inspect_stats, "Inspect Disk Statistics");
 }
@@ -24,10 +24,16 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time stamp counter increments per microsecond.
+   Initialized by timer_calibrate(). */
+static uint64_t tsc_per_us;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void real_time_delay (int64_t num, int32_t denom);
+static uint64_t rdtsc (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -45,10 +51,13 @@ timer_init (void) {
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the time stamp counter rate used by timer_usec(). */
 void
 timer_calibrate (void) {
 	unsigned high_bit, test_bit;
+	int64_t start;
+	uint64_t tsc;
 
 	ASSERT (intr_get_level () == INTR_ON);
 	printf ("Calibrating timer...  ");
@@ -68,6 +77,18 @@ timer_calibrate (void) {
 			loops_per_tick |= test_bit;
 
 	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+	/* Measure the time stamp counter against one whole tick. */
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	tsc = rdtsc ();
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	tsc_per_us = (rdtsc () - tsc) / (1000000 / TIMER_FREQ);
+	if (tsc_per_us == 0)
+		tsc_per_us = 1;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -87,6 +108,25 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
+/* Returns a time in microseconds, measured from an arbitrary
+   starting point, with much finer resolution than a tick.  Safe
+   to call from an interrupt handler.  Before timer_calibrate()
+   it only advances once per tick. */
+uint64_t
+timer_usec (void) {
+	if (tsc_per_us == 0)
+		return (uint64_t) timer_ticks () * (1000000 / TIMER_FREQ);
+	return rdtsc () / tsc_per_us;
+}
+
+/* Reads the CPU's time stamp counter. */
+static uint64_t
+rdtsc (void) {
+	uint32_t lo, hi;
+	asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
 /* insert_ordered 함수에 사용할 비교 함수 */
 static bool wakeup_tick_compare(const struct list_elem* a, const struct list_elem* b, void *aux UNUSED) {
 	// 두 스레드의 wakeup_tick 값을 비교해 더 작은 값을 가진 스레드를 앞에 오도록 하기
@@ -139,6 +179,21 @@ timer_nsleep (int64_t ns) {
 	real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Busy-waits for approximately US microseconds.  Unlike
+   timer_usleep(), this does not yield the CPU, so it may be used
+   with interrupts disabled, e.g. from an interrupt handler. */
+void
+timer_udelay (int64_t us) {
+	real_time_delay (us, 1000 * 1000);
+}
+
+/* Busy-waits for approximately NS nanoseconds.  May be used with
+   interrupts disabled. */
+void
+timer_ndelay (int64_t ns) {
+	real_time_delay (ns, 1000 * 1000 * 1000);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
@@ -229,3 +284,12 @@ real_time_sleep (int64_t num, int32_t denom) {
 		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 	}
 }
+
+/* Busy-wait for approximately NUM/DENOM seconds. */
+static void
+real_time_delay (int64_t num, int32_t denom) {
+	/* Scale the numerator and denominator down by 1000 to avoid
+	   the possibility of overflow. */
+	ASSERT (denom % 1000 == 0);
+	busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+}
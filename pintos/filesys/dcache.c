@@ -0,0 +1,206 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Dentry cache.
+ *
+ * Maps (parent directory inode sector, name) to the inode sector
+ * of the child, so that resolving a name that was resolved before
+ * costs no directory reads.  Names that are known to be absent
+ * are cached too ("negative" entries), since create and open of
+ * missing files are as common as hits.  The cache holds at most
+ * DCACHE_MAX entries and evicts the least recently used one.
+ * Each file system has a cache of its own, so a busy mounted
+ * file system cannot push the root's names out.
+ *
+ * The directory code keeps it coherent: dir_add inserts the new
+ * name, dir_remove replaces it with a negative entry and drops
+ * every entry under the removed inode, in case it was a
+ * directory whose sector is later reused. */
+
+/* Maximum number of cached entries. */
+#define DCACHE_MAX 512
+
+/* A cached name. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in DENTRIES. */
+	struct list_elem lru_elem;          /* Element in LRU. */
+	disk_sector_t parent;               /* Inode sector of the directory. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+	bool negative;                      /* True if NAME does not exist. */
+	disk_sector_t child;                /* Inode sector, if not NEGATIVE. */
+};
+
+/* The dentry cache of one file system. */
+struct dcache {
+	struct hash dentries;               /* All cached entries. */
+	struct list lru;                    /* Most recently used first. */
+	struct lock lock;                   /* Protects DENTRIES and LRU. */
+};
+
+static uint64_t dentry_hash (const struct hash_elem *, void *);
+static bool dentry_less (const struct hash_elem *, const struct hash_elem *,
+                         void *);
+
+/* Creates the dentry cache of FS. */
+void
+dcache_init (struct filesys *fs) {
+	struct dcache *c = fs->dcache = malloc (sizeof *c);
+	if (c == NULL)
+		PANIC ("dentry cache creation failed");
+	hash_init (&c->dentries, dentry_hash, dentry_less, NULL);
+	list_init (&c->lru);
+	lock_init (&c->lock);
+}
+
+/* Returns the entry cached in C for NAME in PARENT, or a null
+ * pointer.  The caller must hold C's lock. */
+static struct dentry *
+find (struct dcache *c, disk_sector_t parent, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&c->dentries, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from C and frees it.
+ * The caller must hold C's lock. */
+static void
+evict (struct dcache *c, struct dentry *d) {
+	hash_delete (&c->dentries, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	free (d);
+}
+
+/* Frees the dentry cache of FS, which is being unmounted. */
+void
+dcache_destroy (struct filesys *fs) {
+	struct dcache *c = fs->dcache;
+
+	while (!list_empty (&c->lru))
+		evict (c, list_entry (list_front (&c->lru), struct dentry, lru_elem));
+	hash_destroy (&c->dentries, NULL);
+	free (c);
+	fs->dcache = NULL;
+}
+
+/* Looks up NAME in the directory of FS whose inode is at PARENT.
+ * On DCACHE_HIT, stores the child's inode sector in *CHILD. */
+enum dcache_result
+dcache_lookup (struct filesys *fs, disk_sector_t parent, const char *name,
+		disk_sector_t *child) {
+	struct dcache *c = fs->dcache;
+	enum dcache_result result = DCACHE_MISS;
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return DCACHE_MISS;
+
+	lock_acquire (&c->lock);
+	d = find (c, parent, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&c->lru, &d->lru_elem);
+		if (d->negative)
+			result = DCACHE_NEGATIVE;
+		else {
+			*child = d->child;
+			result = DCACHE_HIT;
+		}
+	}
+	lock_release (&c->lock);
+	return result;
+}
+
+/* Records in C that NAME in PARENT is CHILD, or is absent if
+ * NEGATIVE.  Replaces any existing entry for the name.  Failure
+ * to allocate memory just leaves the name uncached. */
+static void
+insert (struct dcache *c, disk_sector_t parent, const char *name,
+		bool negative, disk_sector_t child) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&c->lock);
+	d = find (c, parent, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (hash_size (&c->dentries) >= DCACHE_MAX)
+			evict (c, list_entry (list_back (&c->lru), struct dentry, lru_elem));
+		d = malloc (sizeof *d);
+		if (d == NULL) {
+			lock_release (&c->lock);
+			return;
+		}
+		d->parent = parent;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&c->dentries, &d->hash_elem);
+	}
+	d->negative = negative;
+	d->child = child;
+	list_push_front (&c->lru, &d->lru_elem);
+	lock_release (&c->lock);
+}
+
+/* Records that NAME in the directory of FS at PARENT has its
+ * inode at CHILD. */
+void
+dcache_insert (struct filesys *fs, disk_sector_t parent, const char *name,
+		disk_sector_t child) {
+	insert (fs->dcache, parent, name, false, child);
+}
+
+/* Records that there is no NAME in the directory of FS at
+ * PARENT. */
+void
+dcache_insert_negative (struct filesys *fs, disk_sector_t parent,
+		const char *name) {
+	insert (fs->dcache, parent, name, true, 0);
+}
+
+/* Drops every cached name in the directory of FS at PARENT. */
+void
+dcache_purge_dir (struct filesys *fs, disk_sector_t parent) {
+	struct dcache *c = fs->dcache;
+	struct list_elem *e, *next;
+
+	lock_acquire (&c->lock);
+	for (e = list_begin (&c->lru); e != list_end (&c->lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (d->parent == parent)
+			evict (c, d);
+	}
+	lock_release (&c->lock);
+}
+
+/* Returns a hash value for dentry E. */
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_int (d->parent) ^ hash_string (d->name);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp (a->name, b->name) < 0;
+}
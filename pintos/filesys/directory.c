@@ -1,7 +1,10 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -19,11 +22,77 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Hashed directories.
+ *
+ * A directory starts out as a flat array of entries that is
+ * searched linearly.  Once it holds DIR_INDEX_THRESHOLD entries
+ * and has no free slot left, it is rewritten in hashed form:
+ * sector 0 of its data holds a dir_index header, and the
+ * following 1 << DEPTH sectors are buckets of entries.  An
+ * entry lives in the bucket selected by the low DEPTH bits of
+ * the hash of its name, so a lookup reads the header and a
+ * single bucket.  When a bucket fills up the table doubles,
+ * splitting every bucket on the next hash bit one sector at a
+ * time.
+ *
+ * The header's magic overlays the inode_sector of the first
+ * linear entry, and is never a valid sector number, which is how
+ * the two formats are told apart. */
+
+/* Entry count at which a linear directory is converted. */
+#define DIR_INDEX_THRESHOLD 64
+
+/* Identifies a hashed directory. */
+#define DIR_INDEX_MAGIC 0xfffffffe
+
+/* Largest table: 1 << DIR_INDEX_MAX_DEPTH buckets. */
+#define DIR_INDEX_MAX_DEPTH 16
+
+/* Number of entries in a bucket sector. */
+#define DIR_BUCKET_ENTRIES (DISK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* On-disk header of a hashed directory, at offset 0. */
+struct dir_index {
+	disk_sector_t magic;                /* DIR_INDEX_MAGIC. */
+	uint32_t depth;                     /* Table has 1 << DEPTH buckets. */
+};
+
+/* A bucket of a hashed directory.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_bucket {
+	struct dir_entry entries[DIR_BUCKET_ENTRIES];
+	uint8_t unused[DISK_SECTOR_SIZE
+		- DIR_BUCKET_ENTRIES * sizeof (struct dir_entry)];
+};
+
+/* Returns the byte offset of bucket IDX. */
+static inline off_t
+bucket_ofs (size_t idx) {
+	return (off_t) (idx + 1) * DISK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that NAME hashes to in a table of depth
+ * DEPTH. */
+static inline size_t
+bucket_of (const char *name, uint32_t depth) {
+	return hash_string (name) & ((1u << depth) - 1);
+}
+
+/* Reads DIR's index header into *IDX.
+ * Returns true if DIR is hashed, false if it is linear. */
+static bool
+read_index (const struct dir *dir, struct dir_index *idx) {
+	return inode_length (dir->inode) >= 2 * DISK_SECTOR_SIZE
+		&& inode_read_at (dir->inode, idx, sizeof *idx, 0) == sizeof *idx
+		&& idx->magic == DIR_INDEX_MAGIC;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+ * given SECTOR of FS.  Returns true if successful, false on
+ * failure. */
 bool
-dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+dir_create (struct filesys *fs, disk_sector_t sector, size_t entry_cnt) {
+	return inode_create (fs, sector, entry_cnt * sizeof (struct dir_entry));
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -34,6 +103,7 @@ dir_open (struct inode *inode) {
 	if (inode != NULL && dir != NULL) {
 		dir->inode = inode;
 		dir->pos = 0;
+		inode_set_metadata (inode);
 		return dir;
 	} else {
 		inode_close (inode);
@@ -42,11 +112,11 @@ dir_open (struct inode *inode) {
 	}
 }
 
-/* Opens the root directory and returns a directory for it.
+/* Opens the root directory of FS and returns a directory for it.
  * Return true if successful, false on failure. */
 struct dir *
-dir_open_root (void) {
-	return dir_open (inode_open (ROOT_DIR_SECTOR));
+dir_open_root (struct filesys *fs) {
+	return dir_open (inode_open (fs, ROOT_DIR_SECTOR (fs)));
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -80,11 +150,36 @@ static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
+	struct dir_index idx;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (read_index (dir, &idx)) {
+		struct dir_bucket *b = malloc (sizeof *b);
+		off_t bofs = bucket_ofs (bucket_of (name, idx.depth));
+		bool found = false;
+		size_t i;
+
+		if (b == NULL
+				|| inode_read_at (dir->inode, b, sizeof *b, bofs) != sizeof *b) {
+			free (b);
+			return false;
+		}
+		for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+			if (b->entries[i].in_use && !strcmp (name, b->entries[i].name)) {
+				if (ep != NULL)
+					*ep = b->entries[i];
+				if (ofsp != NULL)
+					*ofsp = bofs + i * sizeof (struct dir_entry);
+				found = true;
+				break;
+			}
+		free (b);
+		return found;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -97,6 +192,177 @@ lookup (const struct dir *dir, const char *name,
 	return false;
 }
 
+/* Doubles the bucket table of hashed directory DIR, whose
+ * header is *IDX, moving each entry of bucket I whose next hash
+ * bit is set to bucket I + (1 << depth).  Works one bucket at a
+ * time, so memory use does not depend on directory size.
+ * Returns true if successful, false if the table is already at
+ * its maximum size or the directory cannot grow. */
+static bool
+index_split (struct dir *dir, struct dir_index *idx) {
+	size_t half = (size_t) 1 << idx->depth;
+	struct dir_bucket *old = NULL, *lo = NULL, *hi = NULL;
+	bool success = false;
+	size_t i, j;
+
+	if (idx->depth >= DIR_INDEX_MAX_DEPTH)
+		return false;
+
+	old = malloc (sizeof *old);
+	lo = malloc (sizeof *lo);
+	hi = calloc (1, sizeof *hi);
+	if (old == NULL || lo == NULL || hi == NULL)
+		goto done;
+
+	/* Extend the directory in one step by writing its new last
+	 * bucket first. */
+	if (inode_write_at (dir->inode, hi, sizeof *hi, bucket_ofs (2 * half - 1))
+			!= sizeof *hi)
+		goto done;
+
+	for (i = 0; i < half; i++) {
+		size_t lo_cnt = 0, hi_cnt = 0;
+
+		if (inode_read_at (dir->inode, old, sizeof *old, bucket_ofs (i))
+				!= sizeof *old)
+			goto done;
+		memset (lo, 0, sizeof *lo);
+		memset (hi, 0, sizeof *hi);
+		for (j = 0; j < DIR_BUCKET_ENTRIES; j++) {
+			struct dir_entry *e = &old->entries[j];
+			if (!e->in_use)
+				continue;
+			if (hash_string (e->name) & half)
+				hi->entries[hi_cnt++] = *e;
+			else
+				lo->entries[lo_cnt++] = *e;
+		}
+		if (inode_write_at (dir->inode, hi, sizeof *hi, bucket_ofs (i + half))
+				!= sizeof *hi
+				|| inode_write_at (dir->inode, lo, sizeof *lo, bucket_ofs (i))
+				!= sizeof *lo)
+			goto done;
+	}
+
+	idx->depth++;
+	success = inode_write_at (dir->inode, idx, sizeof *idx, 0) == sizeof *idx;
+
+done:
+	free (old);
+	free (lo);
+	free (hi);
+	return success;
+}
+
+/* Adds entry E to hashed directory DIR, whose header is *IDX,
+ * splitting the table as often as needed to make room.
+ * Returns true if successful, false on failure. */
+static bool
+index_add (struct dir *dir, struct dir_index *idx, const struct dir_entry *e) {
+	struct dir_bucket *b = malloc (sizeof *b);
+	bool success = false;
+
+	if (b == NULL)
+		return false;
+
+	for (;;) {
+		off_t bofs = bucket_ofs (bucket_of (e->name, idx->depth));
+		size_t i;
+
+		if (inode_read_at (dir->inode, b, sizeof *b, bofs) != sizeof *b)
+			break;
+		for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+			if (!b->entries[i].in_use)
+				break;
+		if (i < DIR_BUCKET_ENTRIES) {
+			off_t eofs = bofs + i * sizeof *e;
+			success = inode_write_at (dir->inode, e, sizeof *e, eofs) == sizeof *e;
+			break;
+		}
+		if (!index_split (dir, idx))
+			break;
+	}
+	free (b);
+	return success;
+}
+
+/* Rewrites linear directory DIR in hashed form.  The table is
+ * sized so that buckets start out at most half full.
+ * Returns true if successful.  On failure DIR is left in linear
+ * form, unless a disk error struck in the middle of the
+ * rewrite. */
+static bool
+index_convert (struct dir *dir) {
+	off_t length = inode_length (dir->inode);
+	size_t slot_cnt = length / sizeof (struct dir_entry);
+	struct dir_entry *entries = NULL;
+	struct dir_bucket *b = NULL;
+	struct dir_index idx;
+	size_t cnt = 0, i, j;
+	bool success = false;
+
+	entries = malloc (slot_cnt * sizeof *entries);
+	b = calloc (1, sizeof *b);
+	if (entries == NULL || b == NULL)
+		goto done;
+
+	for (i = 0; i < slot_cnt; i++)
+		if (inode_read_at (dir->inode, &entries[cnt], sizeof *entries,
+					i * sizeof *entries) == sizeof *entries
+				&& entries[cnt].in_use)
+			cnt++;
+
+	/* Pick a depth at which no bucket overflows. */
+	idx.magic = DIR_INDEX_MAGIC;
+	for (idx.depth = 0; ((size_t) DIR_BUCKET_ENTRIES << idx.depth) < 2 * cnt;
+			idx.depth++)
+		continue;
+	for (;; idx.depth++) {
+		size_t *fill;
+		bool fits = true;
+
+		if (idx.depth > DIR_INDEX_MAX_DEPTH)
+			goto done;
+		fill = calloc ((size_t) 1 << idx.depth, sizeof *fill);
+		if (fill == NULL)
+			goto done;
+		for (i = 0; i < cnt && fits; i++)
+			fits = ++fill[bucket_of (entries[i].name, idx.depth)]
+				<= DIR_BUCKET_ENTRIES;
+		free (fill);
+		if (fits)
+			break;
+	}
+
+	/* Grow to full size before overwriting anything. */
+	if (inode_write_at (dir->inode, b, sizeof *b,
+				bucket_ofs (((size_t) 1 << idx.depth) - 1)) != sizeof *b)
+		goto done;
+
+	for (i = 0; i < ((size_t) 1 << idx.depth); i++) {
+		size_t n = 0;
+
+		memset (b, 0, sizeof *b);
+		for (j = 0; j < cnt; j++)
+			if (bucket_of (entries[j].name, idx.depth) == i)
+				b->entries[n++] = entries[j];
+		if (inode_write_at (dir->inode, b, sizeof *b, bucket_ofs (i))
+				!= sizeof *b)
+			goto done;
+	}
+
+	/* Finally write the header, which switches the format. */
+	memset (b, 0, sizeof *b);
+	memcpy (b, &idx, sizeof idx);
+	success = inode_write_at (dir->inode, b, DISK_SECTOR_SIZE, 0)
+		== DISK_SECTOR_SIZE;
+
+done:
+	free (entries);
+	free (b);
+	return success;
+}
+
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
@@ -104,15 +370,32 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	struct filesys *fs;
+	disk_sector_t parent, child;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	fs = inode_get_fs (dir->inode);
+	parent = inode_get_inumber (dir->inode);
+	switch (dcache_lookup (fs, parent, name, &child)) {
+		case DCACHE_HIT:
+			*inode = inode_open (fs, child);
+			break;
+		case DCACHE_NEGATIVE:
+			*inode = NULL;
+			break;
+		case DCACHE_MISS:
+			if (lookup (dir, name, &e, NULL)) {
+				dcache_insert (fs, parent, name, e.inode_sector);
+				*inode = inode_open (fs, e.inode_sector);
+			} else {
+				dcache_insert_negative (fs, parent, name);
+				*inode = NULL;
+			}
+			break;
+	}
 
 	return *inode != NULL;
 }
@@ -126,6 +409,8 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	struct dir_entry e;
+	struct dir_index idx;
+	size_t used = 0;
 	off_t ofs;
 	bool success = false;
 
@@ -136,10 +421,17 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	/* Check that NAME is not in use.  A cached negative entry
+	 * saves searching the directory. */
+	struct filesys *fs = inode_get_fs (dir->inode);
+	disk_sector_t parent = inode_get_inumber (dir->inode), child;
+	if (dcache_lookup (fs, parent, name, &child) != DCACHE_NEGATIVE
+			&& lookup (dir, name, NULL, NULL))
 		goto done;
 
+	if (read_index (dir, &idx))
+		goto add_hashed;
+
 	/* Set OFS to offset of free slot.
 	 * If there are no free slots, then it will be set to the
 	 * current end-of-file.
@@ -151,14 +443,32 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 			ofs += sizeof e)
 		if (!e.in_use)
 			break;
+		else
+			used++;
+
+	/* A full, large linear directory switches to the hashed
+	 * format instead of growing further. */
+	if (used >= DIR_INDEX_THRESHOLD && ofs == inode_length (dir->inode)
+			&& index_convert (dir) && read_index (dir, &idx))
+		goto add_hashed;
 
 	/* Write slot. */
 	e.in_use = true;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	goto done;
+
+add_hashed:
+	memset (&e, 0, sizeof e);
+	e.in_use = true;
+	strlcpy (e.name, name, sizeof e.name);
+	e.inode_sector = inode_sector;
+	success = index_add (dir, &idx, &e);
 
 done:
+	if (success)
+		dcache_insert (fs, parent, name, inode_sector);
 	return success;
 }
 
@@ -167,6 +477,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct filesys *fs = inode_get_fs (dir->inode);
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -180,7 +491,7 @@ dir_remove (struct dir *dir, const char *name) {
 		goto done;
 
 	/* Open inode. */
-	inode = inode_open (e.inode_sector);
+	inode = inode_open (fs, e.inode_sector);
 	if (inode == NULL)
 		goto done;
 
@@ -189,8 +500,11 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
-	/* Remove inode. */
+	/* Remove inode.  If it was a directory, names cached under it
+	 * must not outlive it. */
 	inode_remove (inode);
+	dcache_insert_negative (fs, inode_get_inumber (dir->inode), name);
+	dcache_purge_dir (fs, e.inode_sector);
 	success = true;
 
 done:
@@ -204,8 +518,20 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
-
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	struct dir_index idx;
+	bool hashed = read_index (dir, &idx);
+
+	for (;;) {
+		if (hashed) {
+			/* Skip the header and the padding after each bucket. */
+			if (dir->pos < DISK_SECTOR_SIZE)
+				dir->pos = DISK_SECTOR_SIZE;
+			else if (dir->pos % DISK_SECTOR_SIZE
+					>= (off_t) (DIR_BUCKET_ENTRIES * sizeof e))
+				dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE);
+		}
+		if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+			break;
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
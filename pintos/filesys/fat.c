@@ -1,6 +1,8 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -22,172 +24,498 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;        /* Next-fit hint: where the next scan starts. */
+	struct lock write_lock;     /* Protects FAT, FREE_MAP, DIRTY, LAST_CLST. */
+
+	struct bitmap *free_map;    /* One bit per cluster, set if in use. */
+	size_t free_cnt;            /* Number of clear bits in FREE_MAP. */
+	size_t reserved;            /* Free clusters promised by fat_reserve(). */
+	struct bitmap *dirty;       /* One bit per FAT sector, set if modified. */
 };
 
-static struct fat_fs *fat_fs;
+/* Number of FAT entries that fit in one sector. */
+#define FAT_ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
+/* Set in the FAT entry of an allocated cluster whose data has
+ * never been written, so that it reads as zeros.  Lets files be
+ * created or extended without writing zeros to every cluster.
+ * Never visible through fat_get(). */
+#define FAT_UNWRITTEN 0x80000000
+
+static void fat_boot_create (struct filesys *);
+static void fat_fs_init (struct fat_fs *);
+static void fat_build_maps (struct fat_fs *);
+static void fat_set (struct fat_fs *, cluster_t clst, cluster_t val);
+static cluster_t extend_chain (struct fat_fs *, cluster_t clst, size_t cnt,
+		bool unwritten);
 
-void fat_boot_create (void);
-void fat_fs_init (void);
+/* Returns true if disk D holds a FAT file system. */
+bool
+fat_probe (struct disk *d) {
+	struct fat_boot *bs = malloc (DISK_SECTOR_SIZE);
+	bool found;
 
+	if (bs == NULL)
+		return false;
+	filesys_read_sectors (d, FAT_BOOT_SECTOR, 1, bs);
+	found = bs->magic == FAT_MAGIC;
+	free (bs);
+	return found;
+}
+
+/* Sets up the in-memory FAT of FS from its boot sector, or from
+ * a new boot sector if the disk has none. */
 void
-fat_init (void) {
-	fat_fs = calloc (1, sizeof (struct fat_fs));
-	if (fat_fs == NULL)
+fat_init (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat = calloc (1, sizeof (struct fat_fs));
+	if (fat == NULL)
 		PANIC ("FAT init failed");
 
 	// Read boot sector from the disk
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
+	filesys_read_sectors (fs->disk, FAT_BOOT_SECTOR, 1, bounce);
+	memcpy (&fat->bs, bounce, sizeof (fat->bs));
 	free (bounce);
 
 	// Extract FAT info
-	if (fat_fs->bs.magic != FAT_MAGIC)
-		fat_boot_create ();
-	fat_fs_init ();
+	if (fat->bs.magic != FAT_MAGIC)
+		fat_boot_create (fs);
+	fat_fs_init (fat);
 }
 
-void
-fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
+/* Loads the FAT of FS from disk.  Returns false if the file
+ * system predates the journal and must be reformatted. */
+bool
+fat_open (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
+
+	if (fat->bs.fat_start < JOURNAL_SECTOR + JOURNAL_SECTORS)
+		return false;
+
+	free (fat->fat);
+	fat->fat = calloc (fat->fat_length, sizeof (cluster_t));
+	if (fat->fat == NULL)
 		PANIC ("FAT load failed");
 
 	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+	// The whole sectors go in one multi-sector read; a partial last
+	// sector goes through a bounce buffer.
+	uint8_t *buffer = (uint8_t *) fat->fat;
+	const off_t fat_size_in_bytes = fat->fat_length * sizeof (cluster_t);
+	size_t full = fat_size_in_bytes / DISK_SECTOR_SIZE;
+	off_t bytes_left = fat_size_in_bytes % DISK_SECTOR_SIZE;
+	if (full > fat->bs.fat_sectors) {
+		full = fat->bs.fat_sectors;
+		bytes_left = 0;
 	}
+	if (full > 0)
+		filesys_read_sectors (fs->disk, fat->bs.fat_start, full, buffer);
+	if (bytes_left > 0 && full < fat->bs.fat_sectors) {
+		uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT load failed");
+		filesys_read_sectors (fs->disk, fat->bs.fat_start + full, 1,
+				bounce);
+		memcpy (buffer + full * DISK_SECTOR_SIZE, bounce, bytes_left);
+		free (bounce);
+	}
+
+	fat_build_maps (fat);
+	return true;
 }
 
 void
-fat_close (void) {
+fat_close (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
+
 	// Write FAT boot sector
 	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
-	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	memcpy (bounce, &fat->bs, sizeof (fat->bs));
+	filesys_write_sectors (fs->disk, FAT_BOOT_SECTOR, 1, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
+	// Commit the FAT sectors that changed since the last sync
+	journal_commit (fs);
+}
+
+/* Frees the in-memory FAT of FS, which has been closed. */
+void
+fat_destroy (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
+
+	if (fat == NULL)
+		return;
+	if (fat->free_map != NULL)
+		bitmap_destroy (fat->free_map);
+	if (fat->dirty != NULL)
+		bitmap_destroy (fat->dirty);
+	free (fat->fat);
+	free (fat);
+	fs->fat = NULL;
+}
+
+/* Logs every FAT sector modified since the last sync in the
+ * journal, which calls this at each commit.  Clean sectors are
+ * not touched, so the cost is proportional to the number of
+ * clusters that changed rather than to the size of the table. */
+void
+fat_sync (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
+	const size_t fat_bytes = fat->fat_length * sizeof (cluster_t);
+	uint8_t *buffer = (uint8_t *) fat->fat;
+	uint8_t *bounce = NULL;
+	size_t i;
+
+	lock_acquire (&fat->write_lock);
+	for (i = bitmap_scan (fat->dirty, 0, 1, true); i != BITMAP_ERROR;
+			i = bitmap_scan (fat->dirty, i + 1, 1, true)) {
+		size_t ofs = i * DISK_SECTOR_SIZE;
+		disk_sector_t sector = fat->bs.fat_start + i;
+
+		if (ofs + DISK_SECTOR_SIZE <= fat_bytes)
+			journal_write (fs, sector, buffer + ofs);
+		else {
+			/* Last, partially used sector of the table. */
+			if (bounce == NULL) {
+				bounce = calloc (1, DISK_SECTOR_SIZE);
+				if (bounce == NULL)
+					PANIC ("FAT sync failed");
+			}
+			if (ofs < fat_bytes)
+				memcpy (bounce, buffer + ofs, fat_bytes - ofs);
+			journal_write (fs, sector, bounce);
 		}
+		bitmap_reset (fat->dirty, i);
 	}
+	lock_release (&fat->write_lock);
+	free (bounce);
 }
 
 void
-fat_create (void) {
+fat_create (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
+
 	// Create FAT boot
-	fat_boot_create ();
-	fat_fs_init ();
+	fat_boot_create (fs);
+	fat_fs_init (fat);
 
 	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
+	free (fat->fat);
+	fat->fat = calloc (fat->fat_length, sizeof (cluster_t));
+	if (fat->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_build_maps (fat);
+
+	// The whole table is new, so all of it must reach the disk
+	bitmap_set_all (fat->dirty, true);
 
 	// Set up ROOT_DIR_CLST
-	fat_put (ROOT_DIR_CLUSTER, EOChain);
+	fat_put (fs, ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	filesys_write_sectors (fs->disk, cluster_to_sector (fs, ROOT_DIR_CLUSTER), 1,
+			buf);
 	free (buf);
 }
 
-void
-fat_boot_create (void) {
+static void
+fat_boot_create (struct filesys *fs) {
+	struct fat_fs *fat = fs->fat;
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (disk_size (fs->disk) - 1)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
-	fat_fs->bs = (struct fat_boot){
+	fat->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
-	    .total_sectors = disk_size (filesys_disk),
-	    .fat_start = 1,
+	    .total_sectors = disk_size (fs->disk),
+	    .fat_start = JOURNAL_SECTOR + JOURNAL_SECTORS,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
 	};
 }
 
-void
-fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+static void
+fat_fs_init (struct fat_fs *fat) {
+	size_t data_sectors;
+
+	fat->data_start = fat->bs.fat_start + fat->bs.fat_sectors;
+
+	/* Cluster 0 is never used, so cluster N starts at sector
+	 * DATA_START + (N - 1) * SECTORS_PER_CLUSTER. */
+	data_sectors = fat->bs.total_sectors - fat->data_start;
+	fat->fat_length = data_sectors / SECTORS_PER_CLUSTER + 1;
+	if (fat->fat_length > fat->bs.fat_sectors * FAT_ENTRIES_PER_SECTOR)
+		fat->fat_length = fat->bs.fat_sectors * FAT_ENTRIES_PER_SECTOR;
+
+	fat->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat->write_lock);
+}
+
+/* (Re)builds the in-memory free-cluster bitmap from the FAT and
+ * allocates a clean dirty-sector map.  Called whenever a new
+ * table is loaded or created. */
+static void
+fat_build_maps (struct fat_fs *fat) {
+	cluster_t clst;
+
+	if (fat->free_map != NULL)
+		bitmap_destroy (fat->free_map);
+	if (fat->dirty != NULL)
+		bitmap_destroy (fat->dirty);
+
+	fat->free_map = bitmap_create (fat->fat_length);
+	fat->dirty = bitmap_create (fat->bs.fat_sectors);
+	if (fat->free_map == NULL || fat->dirty == NULL)
+		PANIC ("FAT bitmap creation failed");
+
+	/* Cluster 0 is reserved. */
+	bitmap_mark (fat->free_map, 0);
+	fat->free_cnt = fat->fat_length - 1;
+	for (clst = 1; clst < fat->fat_length; clst++)
+		if (fat->fat[clst] != 0) {
+			bitmap_mark (fat->free_map, clst);
+			fat->free_cnt--;
+		}
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Sets FAT entry CLST to VAL and records its sector as dirty.
+ * Keeps the free-cluster bitmap in step with the table, and
+ * the FAT_UNWRITTEN bit of an allocated cluster as it was.
+ * The caller must hold the write lock. */
+static void
+fat_set (struct fat_fs *fat, cluster_t clst, cluster_t val) {
+	ASSERT (clst >= 1 && clst < fat->fat_length);
+	ASSERT (lock_held_by_current_thread (&fat->write_lock));
+
+	if (fat->fat[clst] == 0 && val != 0) {
+		bitmap_mark (fat->free_map, clst);
+		fat->free_cnt--;
+	} else if (fat->fat[clst] != 0 && val == 0) {
+		bitmap_reset (fat->free_map, clst);
+		fat->free_cnt++;
+	}
+	fat->fat[clst] = val != 0 ? val | (fat->fat[clst] & FAT_UNWRITTEN) : 0;
+	bitmap_mark (fat->dirty, clst / FAT_ENTRIES_PER_SECTOR);
+}
+
+/* Finds a run of CNT free clusters, starting at the next-fit hint
+ * and wrapping around to the beginning of the table once.
+ * Returns the first cluster of the run, or 0 if there is none.
+ * The caller must hold the write lock. */
+static cluster_t
+find_free_run (struct fat_fs *fat, size_t cnt) {
+	size_t idx = bitmap_scan (fat->free_map, fat->last_clst, cnt, false);
+	if (idx == BITMAP_ERROR && fat->last_clst != 0)
+		idx = bitmap_scan (fat->free_map, 0, cnt, false);
+	return idx != BITMAP_ERROR ? idx : 0;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
-fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+fat_create_chain (struct filesys *fs, cluster_t clst) {
+	return fat_extend_chain (fs, clst, 1, false);
+}
+
+/* Allocates CNT clusters and links them into a chain after CLST,
+ * or starts a new chain if CLST is 0.  Whatever used to follow
+ * CLST now follows the last new cluster.  If UNWRITTEN, the new
+ * clusters are marked as never written (see fat_unwritten()).
+ * The clusters are taken as a single contiguous run if one is
+ * available, otherwise in as few pieces as the next-fit scan
+ * finds.  Returns the first new cluster, or 0 without changing
+ * anything if fewer than CNT clusters are free and unreserved. */
+cluster_t
+fat_extend_chain (struct filesys *fs, cluster_t clst, size_t cnt,
+		bool unwritten) {
+	struct fat_fs *fat = fs->fat;
+	cluster_t first = 0;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat->write_lock);
+	if (fat->free_cnt - fat->reserved >= cnt)
+		first = extend_chain (fat, clst, cnt, unwritten);
+	lock_release (&fat->write_lock);
+	return first;
+}
+
+/* Sets aside CNT free clusters for a later fat_claim_chain(), so
+ * that data can be accepted now and placed later.  Returns false
+ * if there are not that many free clusters. */
+bool
+fat_reserve (struct filesys *fs, size_t cnt) {
+	struct fat_fs *fat = fs->fat;
+	bool success;
+
+	lock_acquire (&fat->write_lock);
+	success = fat->free_cnt - fat->reserved >= cnt;
+	if (success)
+		fat->reserved += cnt;
+	lock_release (&fat->write_lock);
+	return success;
+}
+
+/* Gives back CNT clusters reserved with fat_reserve(). */
+void
+fat_unreserve (struct filesys *fs, size_t cnt) {
+	struct fat_fs *fat = fs->fat;
+
+	lock_acquire (&fat->write_lock);
+	ASSERT (fat->reserved >= cnt);
+	fat->reserved -= cnt;
+	lock_release (&fat->write_lock);
+}
+
+/* Like fat_extend_chain(), but takes the CNT clusters from an
+ * earlier fat_reserve(), so it cannot fail.  The clusters are
+ * not marked unwritten: the caller has their data at hand. */
+cluster_t
+fat_claim_chain (struct filesys *fs, cluster_t clst, size_t cnt) {
+	struct fat_fs *fat = fs->fat;
+	cluster_t first;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat->write_lock);
+	ASSERT (fat->reserved >= cnt);
+	fat->reserved -= cnt;
+	first = extend_chain (fat, clst, cnt, false);
+	lock_release (&fat->write_lock);
+	return first;
+}
+
+/* Does the work of fat_extend_chain().  There must be CNT free
+ * clusters.  The caller must hold the write lock. */
+static cluster_t
+extend_chain (struct fat_fs *fat, cluster_t clst, size_t cnt,
+		bool unwritten) {
+	cluster_t first = 0, prev = 0, tail;
+	size_t left = cnt;
+
+	ASSERT (lock_held_by_current_thread (&fat->write_lock));
+	ASSERT (fat->free_cnt >= cnt);
+
+	tail = clst != 0 ? fat->fat[clst] & ~FAT_UNWRITTEN : EOChain;
+
+	while (left > 0) {
+		/* Prefer one run for everything that is left; fall back
+		 * to whatever free cluster the hint points at. */
+		size_t run = left;
+		cluster_t start = find_free_run (fat, run);
+		if (start == 0) {
+			run = 1;
+			start = find_free_run (fat, 1);
+		}
+		ASSERT (start != 0);
+
+		for (cluster_t c = start; c < start + run; c++) {
+			fat_set (fat, c, EOChain);
+			if (unwritten)
+				fat->fat[c] |= FAT_UNWRITTEN;
+			if (prev != 0)
+				fat_set (fat, prev, c);
+			else
+				first = c;
+			prev = c;
+		}
+		left -= run;
+		fat->last_clst = start + run < fat->fat_length ? start + run : 1;
+	}
+
+	fat_set (fat, prev, tail);
+	if (clst != 0)
+		fat_set (fat, clst, first);
+	return first;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
-fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+fat_remove_chain (struct filesys *fs, cluster_t clst, cluster_t pclst) {
+	struct fat_fs *fat = fs->fat;
+
+	lock_acquire (&fat->write_lock);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat->fat[clst] & ~FAT_UNWRITTEN;
+		fat_set (fat, clst, 0);
+		clst = next;
+	}
+	if (pclst != 0)
+		fat_set (fat, pclst, EOChain);
+	lock_release (&fat->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
-fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+fat_put (struct filesys *fs, cluster_t clst, cluster_t val) {
+	struct fat_fs *fat = fs->fat;
+
+	lock_acquire (&fat->write_lock);
+	fat_set (fat, clst, val);
+	lock_release (&fat->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
-fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+fat_get (struct filesys *fs, cluster_t clst) {
+	const struct fat_fs *fat = fs->fat;
+
+	ASSERT (clst >= 1 && clst < fat->fat_length);
+	return fat->fat[clst] & ~FAT_UNWRITTEN;
+}
+
+/* Returns true if allocated cluster CLST has never been written,
+ * so that its contents must be taken to be zeros. */
+bool
+fat_unwritten (struct filesys *fs, cluster_t clst) {
+	const struct fat_fs *fat = fs->fat;
+
+	ASSERT (clst >= 1 && clst < fat->fat_length);
+	return (fat->fat[clst] & FAT_UNWRITTEN) != 0;
+}
+
+/* Records that cluster CLST now holds valid data on disk. */
+void
+fat_set_written (struct filesys *fs, cluster_t clst) {
+	struct fat_fs *fat = fs->fat;
+
+	ASSERT (clst >= 1 && clst < fat->fat_length);
+	lock_acquire (&fat->write_lock);
+	if (fat->fat[clst] & FAT_UNWRITTEN) {
+		fat->fat[clst] &= ~FAT_UNWRITTEN;
+		bitmap_mark (fat->dirty, clst / FAT_ENTRIES_PER_SECTOR);
+	}
+	lock_release (&fat->write_lock);
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
-cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+cluster_to_sector (struct filesys *fs, cluster_t clst) {
+	const struct fat_fs *fat = fs->fat;
+
+	ASSERT (clst >= 1 && clst < fat->fat_length);
+	return fat->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts a sector number in the data area back to the cluster
+ * that contains it. */
+cluster_t
+sector_to_cluster (struct filesys *fs, disk_sector_t sector) {
+	const struct fat_fs *fat = fs->fat;
+
+	ASSERT (sector >= fat->data_start);
+	return (sector - fat->data_start) / SECTORS_PER_CLUSTER + 1;
 }
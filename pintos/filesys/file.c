@@ -140,6 +140,19 @@ off_t file_length(struct file *file) {
   return inode_length(file->inode);
 }
 
+/* Returns the number of disk sectors allocated to FILE's data,
+ * which is less than its length calls for if FILE is sparse. */
+size_t file_blocks(struct file *file) {
+  ASSERT(file != NULL);
+  return inode_blocks(file->inode);
+}
+
+/* Makes FILE's data written so far durable on disk. */
+void file_sync(struct file *file) {
+  ASSERT(file != NULL);
+  inode_sync(file->inode);
+}
+
 /* Sets the current position in FILE to NEW_POS bytes from the
  * start of the file. */
 void file_seek(struct file *file, off_t new_pos) {
@@ -1,17 +1,72 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <list.h>
 #include <stdio.h>
 #include <string.h>
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
+#include "filesys/fat.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
-/* The disk that contains the file system. */
+/* The disk that contains the root file system. */
 struct disk *filesys_disk;
 
-static void do_format (void);
+/* The root file system. */
+struct filesys *root_fs;
+
+/* Mount table.
+ *
+ * A mount attaches the file system of another disk under NAME
+ * in the root directory of file system PARENT.  There are no
+ * subdirectories, so a mount point is a name rather than a
+ * directory: while a file system is mounted there, the path
+ * "NAME/FILE" names FILE in the root directory of the mounted
+ * file system, and NAME itself cannot be created, opened or
+ * removed.  Mounted file systems may have mount points of their
+ * own.
+ *
+ * Operations on a mounted file system mark its mount busy while
+ * they run, and files opened through it keep its inodes open;
+ * either keeps it from being unmounted. */
+struct mount {
+	struct list_elem elem;              /* Element in MOUNTS. */
+	struct filesys *parent;             /* File system mounted on. */
+	char name[NAME_MAX + 1];            /* Mount point in PARENT's root. */
+	struct filesys *fs;                 /* Mounted file system. */
+	int busy_cnt;                       /* Operations in progress in FS. */
+};
+
+/* All mounts, each after the one it is mounted on. */
+static struct list mounts;
+
+/* Protects MOUNTS and the busy counts. */
+static struct lock mount_lock;
+
+/* Number of its own inodes a file system keeps open while it is
+ * mounted: the free map file on the original file system. */
+#ifdef EFILESYS
+#define FS_PINNED_INODES 0
+#else
+#define FS_PINNED_INODES 1
+#endif
+
+/* Smallest disk that can hold a file system: the journal plus a
+ * few sectors for the allocation map and root directory. */
+#define FS_MIN_SECTORS (JOURNAL_SECTOR + JOURNAL_SECTORS + 16)
+
+static struct filesys *fs_open (struct disk *, bool format);
+static void fs_flush (struct filesys *);
+static void fs_free (struct filesys *);
+static void do_format (struct filesys *);
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -22,34 +77,211 @@ filesys_init (bool format) {
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
 	inode_init ();
+	journal_init ();
+	list_init (&mounts);
+	lock_init (&mount_lock);
+
+	root_fs = fs_open (filesys_disk, format);
+	if (root_fs == NULL)
+		PANIC ("file system has no journal; reformat with -f");
+}
+
+/* Shuts down the file system module, writing any unwritten data
+ * to disk. */
+void
+filesys_done (void) {
+	struct list_elem *e;
+
+	/* Mounted file systems first, innermost first. */
+	for (e = list_rbegin (&mounts); e != list_rend (&mounts);
+			e = list_prev (e))
+		fs_flush (list_entry (e, struct mount, elem)->fs);
+	fs_flush (root_fs);
+}
+
+/* Sets up the file system on disk D, formatting it first if
+ * FORMAT is true.  Returns the new file system, or a null
+ * pointer if memory runs out or the file system on D predates
+ * the journal. */
+static struct filesys *
+fs_open (struct disk *d, bool format) {
+	struct filesys *fs = calloc (1, sizeof *fs);
+	bool ok;
+
+	if (fs == NULL)
+		return NULL;
+	fs->disk = d;
+	inode_table_init (fs);
+	dcache_init (fs);
+	journal_open (fs, format);
 
 #ifdef EFILESYS
-	fat_init ();
+	fat_init (fs);
 
 	if (format)
-		do_format ();
+		do_format (fs);
 
-	fat_open ();
+	ok = fat_open (fs);
 #else
 	/* Original FS */
-	free_map_init ();
+	free_map_init (fs);
 
 	if (format)
-		do_format ();
+		do_format (fs);
 
-	free_map_open ();
+	ok = free_map_open (fs);
+	if (!ok)
+		free_map_close (fs);
 #endif
+	if (!ok) {
+		journal_close (fs);
+		fs_free (fs);
+		return NULL;
+	}
+	return fs;
 }
 
-/* Shuts down the file system module, writing any unwritten data
- * to disk. */
-void
-filesys_done (void) {
-	/* Original FS */
+/* Writes any unwritten data of FS to disk. */
+static void
+fs_flush (struct filesys *fs) {
+#ifdef EFILESYS
+	fat_close (fs);
+#else
+	free_map_close (fs);
+	journal_commit (fs);
+#endif
+}
+
+/* Frees the in-memory state of FS, whose journal is closed. */
+static void
+fs_free (struct filesys *fs) {
+	inode_table_destroy (fs);
+	dcache_destroy (fs);
 #ifdef EFILESYS
-	fat_close ();
+	fat_destroy (fs);
 #else
-	free_map_close ();
+	free_map_destroy (fs);
+#endif
+	free (fs);
+}
+
+/* Returns the mount at NAME in the root directory of FS, or a
+ * null pointer.  The caller must hold MOUNT_LOCK. */
+static struct mount *
+mount_find (struct filesys *fs, const char *name) {
+	struct list_elem *e;
+
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e)) {
+		struct mount *m = list_entry (e, struct mount, elem);
+		if (m->parent == fs && !strcmp (m->name, name))
+			return m;
+	}
+	return NULL;
+}
+
+/* Returns the mount through which FS is mounted, or a null
+ * pointer if FS is the root file system.  The caller must hold
+ * MOUNT_LOCK. */
+static struct mount *
+mount_of (struct filesys *fs) {
+	struct list_elem *e;
+
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e)) {
+		struct mount *m = list_entry (e, struct mount, elem);
+		if (m->fs == fs)
+			return m;
+	}
+	return NULL;
+}
+
+/* Follows PATH from the root file system, crossing a mount
+ * point at every component but the last.  On success stores the
+ * file system that holds the last component in *FS and the
+ * component itself in NAME, and returns true.  Fails if a
+ * component is empty or too long, or if one before the last is
+ * not a mount point.  The caller must hold MOUNT_LOCK. */
+static bool
+walk (const char *path, struct filesys **fs, char name[NAME_MAX + 1]) {
+	*fs = root_fs;
+	for (;;) {
+		struct mount *m;
+		size_t len;
+
+		while (*path == '/')
+			path++;
+		len = strcspn (path, "/");
+		if (len == 0 || len > NAME_MAX)
+			return false;
+		memcpy (name, path, len);
+		name[len] = '\0';
+		path += len;
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return true;
+
+		m = mount_find (*fs, name);
+		if (m == NULL)
+			return false;
+		*fs = m->fs;
+	}
+}
+
+/* Starts an operation on the file named by PATH.  Returns the
+ * file system that holds the file and stores the file's name in
+ * its root directory in NAME, or returns a null pointer if PATH
+ * does not resolve or names a mount point.  The file system
+ * cannot be unmounted until path_end(). */
+static struct filesys *
+path_begin (const char *path, char name[NAME_MAX + 1]) {
+	struct filesys *fs;
+
+	lock_acquire (&mount_lock);
+	if (walk (path, &fs, name) && mount_find (fs, name) == NULL) {
+		struct mount *m = mount_of (fs);
+		if (m != NULL)
+			m->busy_cnt++;
+	} else
+		fs = NULL;
+	lock_release (&mount_lock);
+	return fs;
+}
+
+/* Ends an operation on FS started by path_begin(). */
+static void
+path_end (struct filesys *fs) {
+	struct mount *m;
+
+	lock_acquire (&mount_lock);
+	m = mount_of (fs);
+	if (m != NULL)
+		m->busy_cnt--;
+	lock_release (&mount_lock);
+}
+
+/* Frees the inode that inode_create() just wrote at SECTOR of
+ * FS, along with its data, when the file could not be linked
+ * into a directory.  Going through the inode revokes its pending
+ * journal writes, which would otherwise land on the freed blocks
+ * after they are reused.  The caller must be in a journal
+ * transaction. */
+static void
+discard_inode (struct filesys *fs, disk_sector_t sector) {
+	struct inode *inode = inode_open (fs, sector);
+
+	if (inode != NULL) {
+		inode_remove (inode);
+		inode_close (inode);
+		return;
+	}
+
+	/* Out of memory: at least keep the stale inode off the disk.
+	 * Its data blocks leak. */
+	journal_revoke (fs, sector, 1);
+#ifdef EFILESYS
+	fat_remove_chain (fs, sector_to_cluster (fs, sector), 0);
+#else
+	free_map_release (fs, sector, 1);
 #endif
 }
 
@@ -59,15 +291,39 @@ filesys_done (void) {
  * or if internal memory allocation fails. */
 bool
 filesys_create (const char *name, off_t initial_size) {
+	char base[NAME_MAX + 1];
+	struct filesys *fs = path_begin (name, base);
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
-			&& inode_create (inode_sector, initial_size)
-			&& dir_add (dir, name, inode_sector));
-	if (!success && inode_sector != 0)
-		free_map_release (inode_sector, 1);
+
+	if (fs == NULL)
+		return false;
+	journal_begin (fs);
+	struct dir *dir = dir_open_root (fs);
+#ifdef EFILESYS
+	cluster_t inode_clst = fat_create_chain (fs, 0);
+	if (inode_clst != 0)
+		inode_sector = cluster_to_sector (fs, inode_clst);
+	bool created = (dir != NULL
+			&& inode_clst != 0
+			&& inode_create (fs, inode_sector, initial_size));
+	bool success = created && dir_add (dir, base, inode_sector);
+	if (!success && created)
+		discard_inode (fs, inode_sector);
+	else if (!success && inode_clst != 0)
+		fat_remove_chain (fs, inode_clst, 0);
+#else
+	bool created = (dir != NULL
+			&& free_map_allocate (fs, 1, &inode_sector)
+			&& inode_create (fs, inode_sector, initial_size));
+	bool success = created && dir_add (dir, base, inode_sector);
+	if (!success && created)
+		discard_inode (fs, inode_sector);
+	else if (!success && inode_sector != 0)
+		free_map_release (fs, inode_sector, 1);
+#endif
 	dir_close (dir);
+	journal_end (fs);
+	path_end (fs);
 
 	return success;
 }
@@ -79,14 +335,22 @@ filesys_create (const char *name, off_t initial_size) {
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
-	struct dir *dir = dir_open_root ();
+	char base[NAME_MAX + 1];
+	struct filesys *fs = path_begin (name, base);
+	struct dir *dir;
 	struct inode *inode = NULL;
+	struct file *file;
 
+	if (fs == NULL)
+		return NULL;
+	dir = dir_open_root (fs);
 	if (dir != NULL)
-		dir_lookup (dir, name, &inode);
+		dir_lookup (dir, base, &inode);
 	dir_close (dir);
 
-	return file_open (inode);
+	file = file_open (inode);
+	path_end (fs);
+	return file;
 }
 
 /* Deletes the file named NAME.
@@ -95,28 +359,175 @@ filesys_open (const char *name) {
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	char base[NAME_MAX + 1];
+	struct filesys *fs = path_begin (name, base);
+
+	if (fs == NULL)
+		return false;
+	journal_begin (fs);
+	struct dir *dir = dir_open_root (fs);
+	bool success = dir != NULL && dir_remove (dir, base);
 	dir_close (dir);
+	journal_end (fs);
+	path_end (fs);
 
 	return success;
 }
 
-/* Formats the file system. */
+/* Returns true if disk D holds a file system. */
+static bool
+formatted (struct disk *d) {
+#ifdef EFILESYS
+	return fat_probe (d);
+#else
+	return inode_probe (d, FREE_MAP_SECTOR);
+#endif
+}
+
+/* Returns true if disk D can be mounted: it is not on channel 0,
+ * which holds the kernel and the root file system, nor used for
+ * swap, nor already mounted.  The caller must hold MOUNT_LOCK. */
+static bool
+disk_available (struct disk *d, int chan_no) {
+	struct list_elem *e;
+
+	if (d == NULL || chan_no == 0 || disk_size (d) < FS_MIN_SECTORS)
+		return false;
+#ifdef VM
+	if (swap_uses_disk (d))
+		return false;
+#endif
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e))
+		if (list_entry (e, struct mount, elem)->fs->disk == d)
+			return false;
+	return true;
+}
+
+/* Mounts the file system on disk hdCHAN_NO:DEV_NO at PATH, which
+ * must name a file that does not exist in the root directory of
+ * a mounted file system.  Mounting never writes a new file
+ * system: a disk must have been formatted beforehand, by booting
+ * with it as the file system disk and -f.  Returns true if
+ * successful, false if PATH is taken or does not resolve, the
+ * disk has no file system or cannot be mounted (see
+ * disk_available()), or memory runs out. */
+bool
+filesys_mount (const char *path, int chan_no, int dev_no) {
+	char name[NAME_MAX + 1];
+	struct disk *d = disk_get (chan_no, dev_no);
+	struct filesys *parent;
+	struct inode *inode = NULL;
+	struct dir *dir;
+	struct mount *m;
+	bool success = false;
+
+	lock_acquire (&mount_lock);
+	if (!walk (path, &parent, name) || mount_find (parent, name) != NULL
+			|| !disk_available (d, chan_no) || !formatted (d))
+		goto done;
+
+	/* The mount point must not hide a file. */
+	dir = dir_open_root (parent);
+	if (dir == NULL || dir_lookup (dir, name, &inode)) {
+		inode_close (inode);
+		dir_close (dir);
+		goto done;
+	}
+	dir_close (dir);
+
+	m = malloc (sizeof *m);
+	if (m == NULL)
+		goto done;
+	m->fs = fs_open (d, false);
+	if (m->fs == NULL) {
+		free (m);
+		goto done;
+	}
+	m->parent = parent;
+	strlcpy (m->name, name, sizeof m->name);
+	m->busy_cnt = 0;
+	list_push_back (&mounts, &m->elem);
+	success = true;
+
+done:
+	lock_release (&mount_lock);
+	return success;
+}
+
+/* Unmounts the file system mounted at PATH, writing its unwritten
+ * data to disk.  Returns true if successful, false if nothing is
+ * mounted at PATH or the file system is in use: it has open
+ * files, an operation in progress or mounts of its own. */
+bool
+filesys_umount (const char *path) {
+	char name[NAME_MAX + 1];
+	struct filesys *parent;
+	struct mount *m = NULL;
+	struct list_elem *e;
+
+	lock_acquire (&mount_lock);
+	if (walk (path, &parent, name))
+		m = mount_find (parent, name);
+	if (m == NULL || m->busy_cnt > 0
+			|| inode_open_cnt (m->fs) > FS_PINNED_INODES)
+		goto fail;
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e))
+		if (list_entry (e, struct mount, elem)->parent == m->fs)
+			goto fail;
+	list_remove (&m->elem);
+	lock_release (&mount_lock);
+
+	fs_flush (m->fs);
+	journal_close (m->fs);
+	fs_free (m->fs);
+	free (m);
+	return true;
+
+fail:
+	lock_release (&mount_lock);
+	return false;
+}
+
+/* Formats file system FS. */
 static void
-do_format (void) {
+do_format (struct filesys *fs) {
 	printf ("Formatting file system...");
 
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
-	fat_create ();
-	fat_close ();
+	fat_create (fs);
+	if (!dir_create (fs, ROOT_DIR_SECTOR (fs), 16))
+		PANIC ("root directory creation failed");
+	fat_close (fs);
 #else
-	free_map_create ();
-	if (!dir_create (ROOT_DIR_SECTOR, 16))
+	free_map_create (fs);
+	if (!dir_create (fs, ROOT_DIR_SECTOR (fs), 16))
 		PANIC ("root directory creation failed");
-	free_map_close ();
+	free_map_close (fs);
+	journal_commit (fs);
 #endif
 
 	printf ("done.\n");
 }
+
+/* Reads the CNT sectors of disk D starting at SECTOR into BUFFER.
+ *
+ * The file system does its disk I/O through this function and
+ * filesys_write_sectors() so that it is counted as file system
+ * I/O on whatever disk it lives.  The default origin comes from
+ * the disk's role, which would call a file system mounted on
+ * hd1:0 "scratch". */
+void
+filesys_read_sectors (struct disk *d, disk_sector_t sector, size_t cnt,
+		void *buffer) {
+	disk_transfer (d, sector, cnt, buffer, false, DISK_ORIGIN_FILESYS);
+}
+
+/* Writes the CNT sectors of disk D starting at SECTOR from
+ * BUFFER.  See filesys_read_sectors(). */
+void
+filesys_write_sectors (struct disk *d, disk_sector_t sector, size_t cnt,
+		const void *buffer) {
+	disk_transfer (d, sector, cnt, (void *) buffer, true,
+			DISK_ORIGIN_FILESYS);
+}
@@ -4,31 +4,41 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 
-static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+/* The free map of one file system. */
+struct free_map {
+	struct file *file;                  /* Free map file. */
+	struct bitmap *map;                 /* One bit per disk sector. */
+};
 
-/* Initializes the free map. */
+/* Initializes the free map of FS. */
 void
-free_map_init (void) {
-	free_map = bitmap_create (disk_size (filesys_disk));
-	if (free_map == NULL)
+free_map_init (struct filesys *fs) {
+	struct free_map *fm = fs->free_map = calloc (1, sizeof *fm);
+	if (fm == NULL)
+		PANIC ("free map creation failed");
+	fm->map = bitmap_create (disk_size (fs->disk));
+	if (fm->map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
-	bitmap_mark (free_map, FREE_MAP_SECTOR);
-	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_mark (fm->map, FREE_MAP_SECTOR);
+	bitmap_mark (fm->map, ROOT_DIR_SECTOR (fs));
+	bitmap_set_multiple (fm->map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map of FS and
+ * stores the first into *SECTORP.
  * Returns true if successful, false if all sectors were
  * available. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+free_map_allocate (struct filesys *fs, size_t cnt, disk_sector_t *sectorp) {
+	struct free_map *fm = fs->free_map;
+	disk_sector_t sector = bitmap_scan_and_flip (fm->map, 0, cnt, false);
 	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
+			&& fm->file != NULL
+			&& !bitmap_write (fm->map, fm->file)) {
+		bitmap_set_multiple (fm->map, sector, cnt, false);
 		sector = BITMAP_ERROR;
 	}
 	if (sector != BITMAP_ERROR)
@@ -36,42 +46,67 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 	return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors of FS starting at SECTOR available for use. */
 void
-free_map_release (disk_sector_t sector, size_t cnt) {
-	ASSERT (bitmap_all (free_map, sector, cnt));
-	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+free_map_release (struct filesys *fs, disk_sector_t sector, size_t cnt) {
+	struct free_map *fm = fs->free_map;
+
+	ASSERT (bitmap_all (fm->map, sector, cnt));
+	bitmap_set_multiple (fm->map, sector, cnt, false);
+	bitmap_write (fm->map, fm->file);
 }
 
-/* Opens the free map file and reads it from disk. */
-void
-free_map_open (void) {
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
+/* Opens the free map file of FS and reads it from disk.
+ * Returns false if the file system predates the journal and
+ * must be reformatted. */
+bool
+free_map_open (struct filesys *fs) {
+	struct free_map *fm = fs->free_map;
+
+	fm->file = file_open (inode_open (fs, FREE_MAP_SECTOR));
+	if (fm->file == NULL)
 		PANIC ("can't open free map");
-	if (!bitmap_read (free_map, free_map_file))
+	inode_set_metadata (file_get_inode (fm->file));
+	if (!bitmap_read (fm->map, fm->file))
 		PANIC ("can't read free map");
+	return bitmap_all (fm->map, JOURNAL_SECTOR, JOURNAL_SECTORS);
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the free map of FS to disk and closes the free map
+ * file. */
 void
-free_map_close (void) {
-	file_close (free_map_file);
+free_map_close (struct filesys *fs) {
+	file_close (fs->free_map->file);
+	fs->free_map->file = NULL;
 }
 
-/* Creates a new free map file on disk and writes the free map to
- * it. */
+/* Frees the in-memory free map of FS, which has been closed. */
 void
-free_map_create (void) {
+free_map_destroy (struct filesys *fs) {
+	struct free_map *fm = fs->free_map;
+
+	if (fm == NULL)
+		return;
+	bitmap_destroy (fm->map);
+	free (fm);
+	fs->free_map = NULL;
+}
+
+/* Creates a new free map file on the disk of FS and writes the
+ * free map to it. */
+void
+free_map_create (struct filesys *fs) {
+	struct free_map *fm = fs->free_map;
+
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+	if (!inode_create (fs, FREE_MAP_SECTOR, bitmap_file_size (fm->map)))
 		PANIC ("free map creation failed");
 
 	/* Write bitmap to file. */
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
+	fm->file = file_open (inode_open (fs, FREE_MAP_SECTOR));
+	if (fm->file == NULL)
 		PANIC ("can't open free map");
-	if (!bitmap_write (free_map, free_map_file))
+	inode_set_metadata (file_get_inode (fm->file));
+	if (!bitmap_write (fm->map, fm->file))
 		PANIC ("can't write free map");
 }
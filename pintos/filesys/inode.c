@@ -1,24 +1,75 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Bytes of file data that fit in the inode sector itself. */
+#define INODE_INLINE_MAX (DISK_SECTOR_SIZE - 20)
+
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Data lives in INLINE_DATA. */
+#define INODE_LAZY 0x2                  /* WRITTEN is valid. */
+
+/* A range of a file's clusters that has no disk space
+ * allocated and reads as zeros.  On the original file system,
+ * a range of sectors that is allocated but was never written. */
+struct hole {
+	uint32_t idx;                       /* Index of first cluster (sector) in file. */
+	uint32_t cnt;                       /* Number of clusters (sectors). */
+};
+
+/* Number of holes an inode can record. */
+#define INODE_HOLES_MAX \
+	((INODE_INLINE_MAX - sizeof (uint32_t)) / sizeof (struct hole))
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ *
+ * Files of at most INODE_INLINE_MAX bytes keep their data in
+ * the inode sector and own no data blocks, so opening and
+ * reading one costs a single disk access.  Bytes of INLINE_DATA
+ * past LENGTH are always zero.  On the FAT file system an
+ * inline file that grows past INODE_INLINE_MAX is moved out to
+ * clusters.
+ *
+ * Other files on the FAT file system use the same space to
+ * record holes: when a write lands past end of file, the whole
+ * clusters it skips are left unallocated.  The cluster chain
+ * links only the allocated clusters, in file order. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	disk_sector_t start;                /* First data sector (cluster on FAT). */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t flags;                     /* INODE_* flags. */
+	uint32_t written;                   /* Sectors written so far, if INODE_LAZY. */
+	union {
+		uint8_t inline_data[INODE_INLINE_MAX]; /* Data, if INODE_INLINE. */
+		struct {
+			uint32_t hole_cnt;          /* Number of HOLES in use. */
+			struct hole holes[INODE_HOLES_MAX]; /* Sorted by IDX. */
+		};
+	};
 };
 
+/* Returns true if INODE's data is stored inline. */
+static inline bool
+is_inline (const struct inode_disk *data) {
+	return (data->flags & INODE_INLINE) != 0;
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
 static inline size_t
@@ -26,46 +77,786 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+#ifdef EFILESYS
+/* Number of bytes in a cluster. */
+#define CLUSTER_SIZE (DISK_SECTOR_SIZE * SECTORS_PER_CLUSTER)
+
+/* Returns the number of clusters to allocate for an inode SIZE
+ * bytes long. */
+static inline size_t
+bytes_to_clusters (off_t size) {
+	return DIV_ROUND_UP (size, CLUSTER_SIZE);
+}
+
+/* A run of physically consecutive clusters in a file's chain. */
+struct cluster_run {
+	size_t idx;                         /* Index of first cluster in file. */
+	cluster_t start;                    /* First cluster of the run. */
+	size_t cnt;                         /* Number of clusters in the run. */
+};
+#endif
+
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in inode table. */
+	struct list_elem lru_elem;          /* Element in closed-inode LRU. */
+	struct filesys *fs;                 /* File system it belongs to. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	bool loading;                       /* Being read in by inode_open(). */
+	bool closing;                       /* Being written back by inode_close(). */
 	bool removed;                       /* True if deleted, false otherwise. */
+	bool metadata;                      /* Data writes go through the journal. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	struct cluster_run *runs;           /* Cached cluster chain, or NULL. */
+	size_t run_cnt;                     /* Number of runs in RUNS. */
+	size_t run_cap;                     /* Allocated size of RUNS. */
+	uint8_t *delay;                     /* Unplaced tail data, or NULL. */
+	size_t delay_idx;                   /* File cluster index of DELAY. */
+	size_t delay_cnt;                   /* Clusters reserved for DELAY. */
+	off_t delay_length;                 /* File length including DELAY. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Cluster-chain cache.
+ *
+ * Following the FAT from the first cluster makes a lookup at
+ * offset POS cost POS / CLUSTER_SIZE table reads.  Instead, the
+ * first lookup walks the chain once and records it as a sorted
+ * array of runs of clusters consecutive both in the file and on
+ * disk; later lookups binary search that array.  Since the
+ * allocator hands out contiguous runs, most files collapse to a
+ * handful of runs.  Allocating clusters adds them to the cache;
+ * freeing the chain drops it. */
+
+/* Returns the number of runs in INODE's cache that start at or
+ * before file cluster IDX. */
+static size_t
+run_search (const struct inode *inode, size_t idx) {
+	size_t lo = 0, hi = inode->run_cnt;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (inode->runs[mid].idx <= idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Drops INODE's cluster-chain cache. */
+static void
+chain_cache_invalidate (struct inode *inode) {
+	free (inode->runs);
+	inode->runs = NULL;
+	inode->run_cnt = inode->run_cap = 0;
+}
+
+/* Records in INODE's run cache that file cluster IDX is CLST,
+ * merging with neighbouring runs where possible.  On allocation
+ * failure the cache is dropped and false returned, which is
+ * always safe: it is rebuilt on demand. */
+static bool
+chain_cache_add (struct inode *inode, size_t idx, cluster_t clst) {
+	size_t pos;
+	struct cluster_run *prev, *next;
+
+	/* Grow before taking pointers into the array, so that PREV and
+	 * NEXT cannot be left pointing into freed memory. */
+	if (inode->run_cnt == inode->run_cap) {
+		size_t cap = inode->run_cap > 0 ? inode->run_cap * 2 : 4;
+		struct cluster_run *runs = realloc (inode->runs, cap * sizeof *runs);
+		if (runs == NULL) {
+			chain_cache_invalidate (inode);
+			return false;
+		}
+		inode->runs = runs;
+		inode->run_cap = cap;
+	}
+
+	pos = inode->run_cnt > 0 && inode->runs[inode->run_cnt - 1].idx < idx
+		? inode->run_cnt : run_search (inode, idx);
+	prev = pos > 0 ? &inode->runs[pos - 1] : NULL;
+	next = pos < inode->run_cnt ? &inode->runs[pos] : NULL;
+
+	if (prev != NULL && prev->idx + prev->cnt == idx
+			&& prev->start + prev->cnt == clst) {
+		prev->cnt++;
+		if (next != NULL && next->idx == idx + 1 && next->start == clst + 1) {
+			prev->cnt += next->cnt;
+			memmove (next, next + 1,
+					(inode->run_cnt - pos - 1) * sizeof *next);
+			inode->run_cnt--;
+		}
+		return true;
+	}
+	if (next != NULL && next->idx == idx + 1 && next->start == clst + 1) {
+		next->idx--;
+		next->start--;
+		next->cnt++;
+		return true;
+	}
+
+	memmove (&inode->runs[pos + 1], &inode->runs[pos],
+			(inode->run_cnt - pos) * sizeof *inode->runs);
+	inode->runs[pos] = (struct cluster_run) {
+		.idx = idx,
+		.start = clst,
+		.cnt = 1,
+	};
+	inode->run_cnt++;
+	return true;
+}
+
+/* Records in INODE's run cache the CNT clusters chained from
+ * CLST as file clusters IDX onward. */
+static void
+chain_cache_extend (struct inode *inode, size_t idx, cluster_t clst,
+		size_t cnt) {
+	for (; cnt > 0; cnt--, idx++, clst = fat_get (inode->fs, clst))
+		if (!chain_cache_add (inode, idx, clst))
+			return;
+}
+
+/* Walks INODE's cluster chain, skipping holes, and returns the
+ * cluster at file index IDX, or 0 if IDX lies in a hole.  If
+ * CACHE, walks the whole chain instead and records it in the
+ * run cache. */
+static cluster_t
+chain_walk (struct inode *inode, size_t idx, bool cache) {
+	const struct inode_disk *data = &inode->data;
+	size_t total = bytes_to_clusters (data->length);
+	size_t i = 0, h = 0;
+	cluster_t clst = data->start;
+
+	while (i < total) {
+		if (h < data->hole_cnt && i == data->holes[h].idx) {
+			if (!cache && idx < i + data->holes[h].cnt)
+				return 0;
+			i += data->holes[h++].cnt;
+			continue;
+		}
+		if (!cache && i == idx)
+			return clst;
+		if (cache && !chain_cache_add (inode, i, clst))
+			return 0;
+		if (++i < total)
+			clst = fat_get (inode->fs, clst);
+	}
+	return 0;
+}
+
+/* Returns the IDX'th cluster of INODE's data, or 0 if it lies in
+ * a hole.  Builds the run cache on first use, then answers in
+ * O(log runs); falls back to walking the FAT if memory for the
+ * cache cannot be had. */
+static cluster_t
+inode_cluster (struct inode *inode, size_t idx) {
+	size_t pos;
+
+	if (inode->runs == NULL)
+		chain_walk (inode, 0, true);
+	if (inode->runs == NULL)
+		return chain_walk (inode, idx, false);
+
+	pos = run_search (inode, idx);
+	if (pos == 0 || idx - inode->runs[pos - 1].idx >= inode->runs[pos - 1].cnt)
+		return 0;
+	return inode->runs[pos - 1].start + (idx - inode->runs[pos - 1].idx);
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
+	if (pos < inode_length (inode)) {
+#ifdef EFILESYS
+		cluster_t clst = inode_cluster (inode, pos / CLUSTER_SIZE);
+		if (clst == 0)
+			return -1;
+		return cluster_to_sector (inode->fs, clst) + pos % CLUSTER_SIZE / DISK_SECTOR_SIZE;
+#else
 		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+#endif
+	} else
 		return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Writes BUFFER to data sector SECTOR of INODE, through the
+ * journal if INODE holds metadata. */
+static void
+data_write (struct inode *inode, disk_sector_t sector, const void *buffer) {
+	if (inode->metadata)
+		journal_write (inode->fs, sector, buffer);
+	else
+		filesys_write_sectors (inode->fs->disk, sector, 1, buffer);
+}
+
+/* Drops pending journal writes to INODE's sector and data, which
+ * are about to be freed. */
+static void
+inode_revoke (struct inode *inode) {
+	journal_revoke (inode->fs, inode->sector, 1);
+	if (is_inline (&inode->data))
+		return;
+#ifdef EFILESYS
+	size_t cnt = bytes_to_clusters (inode->data.length);
+	size_t i;
+
+	if (inode->runs == NULL)
+		chain_walk (inode, 0, true);
+	if (inode->runs != NULL) {
+		for (i = 0; i < inode->run_cnt; i++)
+			journal_revoke (inode->fs, cluster_to_sector (inode->fs, inode->runs[i].start),
+					inode->runs[i].cnt * SECTORS_PER_CLUSTER);
+	} else {
+		for (i = 0; i < cnt; i++) {
+			cluster_t clst = inode_cluster (inode, i);
+			if (clst != 0)
+				journal_revoke (inode->fs, cluster_to_sector (inode->fs, clst), SECTORS_PER_CLUSTER);
+		}
+	}
+#else
+	journal_revoke (inode->fs, inode->data.start, bytes_to_sectors (inode->data.length));
+#endif
+}
+
+/* Unwritten blocks.
+ *
+ * Creating or growing a file does not write zeros to its new
+ * blocks; they are only marked unwritten.  On the FAT file
+ * system each cluster carries the mark in its FAT entry.  On
+ * the original file system, where a file is one contiguous
+ * extent written front to back in the common case, the inode
+ * records how many leading sectors have been written, plus up
+ * to INODE_HOLES_MAX gaps of unwritten sectors below that mark
+ * that a write past it skipped over.  Reads of unwritten blocks
+ * return zeros without touching the disk, and a block is
+ * initialized only when data is first written to it. */
+
+/* Sectors of zeros written at a time when a gap cannot be
+ * recorded and has to be zeroed instead. */
+#define ZERO_SECTORS 8
+
+static char zeros[DISK_SECTOR_SIZE * ZERO_SECTORS];
+
+#ifdef EFILESYS
+/* Zeroes every sector of unwritten cluster CLST of INODE except
+ * the SKIP'th, which the caller has just written, and marks the
+ * cluster written. */
+static void
+cluster_written (struct inode *inode, cluster_t clst, size_t skip) {
+	size_t i;
+
+	for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+		if (i != skip)
+			filesys_write_sectors (inode->fs->disk,
+					cluster_to_sector (inode->fs, clst) + i, 1, zeros);
+	fat_set_written (inode->fs, clst);
+}
+#else
+/* Writes zeros to the CNT sectors of INODE's data starting at
+ * sector IDX. */
+static void
+zero_sectors (struct inode *inode, size_t idx, size_t cnt) {
+	while (cnt > 0) {
+		size_t n = cnt < ZERO_SECTORS ? cnt : ZERO_SECTORS;
+		filesys_write_sectors (inode->fs->disk, inode->data.start + idx, n,
+				zeros);
+		idx += n;
+		cnt -= n;
+	}
+}
+
+/* Returns the unwritten gap of DATA that holds sector IDX, or a
+ * null pointer if there is none. */
+static struct hole *
+gap_find (struct inode_disk *data, size_t idx) {
+	uint32_t i;
+
+	for (i = 0; i < data->hole_cnt; i++)
+		if (idx >= data->holes[i].idx
+				&& idx < data->holes[i].idx + data->holes[i].cnt)
+			return &data->holes[i];
+	return NULL;
+}
+#endif
+
+/* Returns true if the sector holding byte POS of INODE has never
+ * been written or lies in a hole, so that it reads as zeros. */
+static bool
+sector_unwritten (struct inode *inode, off_t pos) {
+#ifdef EFILESYS
+	cluster_t clst = inode_cluster (inode, pos / CLUSTER_SIZE);
+	return clst == 0 || fat_unwritten (inode->fs, clst);
+#else
+	size_t idx = pos / DISK_SECTOR_SIZE;
+
+	if ((inode->data.flags & INODE_LAZY) == 0)
+		return false;
+	return idx >= inode->data.written || gap_find (&inode->data, idx) != NULL;
+#endif
+}
+
+/* Records that the unwritten sector holding byte POS of INODE
+ * has just been written in full.  On the original file system
+ * the sectors it skips over past the written mark become a gap,
+ * or are zeroed if the inode has no room to record one, and the
+ * caller must write the inode back. */
+static void
+sector_written (struct inode *inode, off_t pos) {
+#ifdef EFILESYS
+	cluster_written (inode, inode_cluster (inode, pos / CLUSTER_SIZE),
+			pos % CLUSTER_SIZE / DISK_SECTOR_SIZE);
+#else
+	struct inode_disk *data = &inode->data;
+	size_t idx = pos / DISK_SECTOR_SIZE;
+	struct hole *h;
+	size_t end;
+
+	if (idx >= data->written) {
+		size_t skip = idx - data->written;
+		if (skip > 0 && data->hole_cnt < INODE_HOLES_MAX)
+			data->holes[data->hole_cnt++] = (struct hole) {
+				.idx = data->written,
+				.cnt = skip,
+			};
+		else if (skip > 0)
+			zero_sectors (inode, data->written, skip);
+		data->written = idx + 1;
+		return;
+	}
+
+	/* Shrink, split or drop the gap that held the sector.  If it
+	 * would have to be split but there is no room, zero the rest
+	 * of it instead. */
+	h = gap_find (data, idx);
+	ASSERT (h != NULL);
+	end = h->idx + h->cnt;
+	if (idx == h->idx) {
+		h->idx++;
+		h->cnt--;
+	} else if (idx + 1 == end)
+		h->cnt--;
+	else if (data->hole_cnt < INODE_HOLES_MAX) {
+		memmove (h + 2, h + 1,
+				(data->hole_cnt - (h - data->holes) - 1) * sizeof *h);
+		h[1] = (struct hole) { .idx = idx + 1, .cnt = end - idx - 1 };
+		h->cnt = idx - h->idx;
+		data->hole_cnt++;
+	} else {
+		zero_sectors (inode, idx + 1, end - idx - 1);
+		h->cnt = idx - h->idx;
+	}
+	if (h->cnt == 0) {
+		memmove (h, h + 1, (data->hole_cnt - (h - data->holes) - 1) * sizeof *h);
+		data->hole_cnt--;
+	}
+#endif
+}
+
+#ifdef EFILESYS
+
+/* Moves the inline data of INODE out to a newly allocated
+ * cluster, leaving its length alone.  The data is written
+ * before the inode, so a crash in between leaves the old inline
+ * file intact.  Returns false if the disk is full. */
+static bool
+inode_spill (struct inode *inode) {
+	struct inode_disk *data = &inode->data;
+	cluster_t first = 0;
+
+	ASSERT (is_inline (data));
+
+	if (data->length > 0) {
+		uint8_t *sector = calloc (1, DISK_SECTOR_SIZE);
+		if (sector == NULL)
+			return false;
+		first = fat_extend_chain (inode->fs, 0, 1, true);
+		if (first == 0) {
+			free (sector);
+			return false;
+		}
+		memcpy (sector, data->inline_data, data->length);
+		data_write (inode, cluster_to_sector (inode->fs, first), sector);
+		cluster_written (inode, first, 0);
+		free (sector);
+	}
+
+	data->start = first;
+	data->flags &= ~INODE_INLINE;
+	memset (data->inline_data, 0, sizeof data->inline_data);
+	journal_write (inode->fs, inode->sector, data);
+	return true;
+}
+
+/* Extends INODE to LENGTH bytes for a write starting at OFS, and
+ * writes the updated inode back.  Whole clusters between the
+ * old end of file and OFS become a hole, if the inode has room
+ * to record one; the rest of the new tail is allocated as
+ * unwritten clusters, in as few runs as the FAT allows.  Inline
+ * inodes stay inline while LENGTH fits.  Returns false if the
+ * disk is full, in which case INODE's length is unchanged. */
+static bool
+inode_grow (struct inode *inode, off_t ofs, off_t length) {
+	struct inode_disk *data = &inode->data;
+	size_t have, need, from;
+
+	ASSERT (length > data->length);
+	ASSERT (ofs < length);
+
+	if (is_inline (data)) {
+		if (length <= INODE_INLINE_MAX) {
+			data->length = length;
+			journal_write (inode->fs, inode->sector, data);
+			return true;
+		}
+		if (!inode_spill (inode))
+			return false;
+	}
+
+	have = bytes_to_clusters (data->length);
+	need = bytes_to_clusters (length);
+	from = have;
+	if ((size_t) ofs / CLUSTER_SIZE > have && data->hole_cnt < INODE_HOLES_MAX)
+		from = ofs / CLUSTER_SIZE;
+
+	if (need > from) {
+		cluster_t last = have > 0 ? inode_cluster (inode, have - 1) : 0;
+		cluster_t first = fat_extend_chain (inode->fs, last, need - from, true);
+		if (first == 0)
+			return false;
+		if (have == 0)
+			data->start = first;
+		if (from > have)
+			data->holes[data->hole_cnt++] = (struct hole) {
+				.idx = have,
+				.cnt = from - have,
+			};
+		if (inode->runs != NULL)
+			chain_cache_extend (inode, from, first, need - from);
+	}
+	data->length = length;
+	journal_write (inode->fs, inode->sector, data);
+	return true;
+}
+
+/* If file cluster IDX of INODE lies in a hole, allocates an
+ * unwritten cluster for it and links it into the chain in file
+ * order.  If the hole would have to be split but the inode has
+ * no room for another one, the rest of the hole from IDX on is
+ * allocated as well.  Returns false if the disk is full. */
+static bool
+inode_fill_hole (struct inode *inode, size_t idx) {
+	struct inode_disk *data = &inode->data;
+	struct hole *h;
+	size_t i, cnt, end;
+	cluster_t prev, first;
+
+	if (is_inline (data))
+		return true;
+	for (i = 0; i < data->hole_cnt; i++)
+		if (idx < data->holes[i].idx + data->holes[i].cnt)
+			break;
+	if (i == data->hole_cnt || idx < data->holes[i].idx)
+		return true;
+	h = &data->holes[i];
+	end = h->idx + h->cnt;
+
+	cnt = 1;
+	if (idx > h->idx && idx + 1 < end && data->hole_cnt == INODE_HOLES_MAX)
+		cnt = end - idx;
+
+	/* Link the new clusters after the last allocated cluster
+	 * before the hole, or at the head of the chain. */
+	prev = h->idx > 0 ? inode_cluster (inode, h->idx - 1) : 0;
+	first = fat_extend_chain (inode->fs, prev, cnt, true);
+	if (first == 0)
+		return false;
+	if (prev == 0) {
+		cluster_t last = first;
+		for (i = 1; i < cnt; i++)
+			last = fat_get (inode->fs, last);
+		fat_put (inode->fs, last, data->start);
+		data->start = first;
+	}
+
+	/* Shrink, split or drop the hole. */
+	if (idx == h->idx) {
+		h->idx++;
+		h->cnt--;
+	} else if (idx + cnt == end)
+		h->cnt -= cnt;
+	else {
+		memmove (h + 2, h + 1,
+				(data->hole_cnt - (h - data->holes) - 1) * sizeof *h);
+		h[1] = (struct hole) { .idx = idx + 1, .cnt = end - idx - 1 };
+		h->cnt = idx - h->idx;
+		data->hole_cnt++;
+	}
+	if (h->cnt == 0) {
+		memmove (h, h + 1, (data->hole_cnt - (h - data->holes) - 1) * sizeof *h);
+		data->hole_cnt--;
+	}
+
+	if (inode->runs != NULL)
+		chain_cache_extend (inode, idx, first, cnt);
+	journal_write (inode->fs, inode->sector, data);
+	return true;
+}
+
+/* Delayed allocation.
+ *
+ * Allocating clusters as each append extends a file interleaves
+ * files that grow at the same time.  Instead, appends to a
+ * regular file from its first unallocated cluster on are kept
+ * in a per-inode buffer of up to DELAY_MAX clusters.  Clusters
+ * are reserved in the FAT as the buffer grows, so a full disk is
+ * still reported at write time, but they are only placed when
+ * the buffer is written back: when it fills up, when a write
+ * leaves a gap after it, and when the inode is last closed.
+ * The allocator then finds one contiguous run for the whole
+ * buffer.  The on-disk length is updated at writeback, after
+ * the data. */
+
+/* Maximum clusters in a delayed-allocation buffer. */
+#define DELAY_MAX 64
+
+/* Writes INODE's delayed data back to newly placed clusters and
+ * extends the on-disk inode over them. */
+static void
+delay_flush (struct inode *inode) {
+	struct inode_disk *data = &inode->data;
+	size_t have = inode->delay_idx;
+	size_t cnt = 0;
+
+	if (inode->delay == NULL)
+		return;
+
+	ASSERT (have == bytes_to_clusters (data->length));
+	if (inode->delay_length > (off_t) (have * CLUSTER_SIZE))
+		cnt = bytes_to_clusters (inode->delay_length) - have;
+	if (cnt > 0) {
+		cluster_t last = have > 0 ? inode_cluster (inode, have - 1) : 0;
+		cluster_t first = fat_claim_chain (inode->fs, last, cnt);
+		cluster_t clst = first;
+		size_t i = 0;
+
+		/* Write each physically contiguous run of the chain with
+		 * a single multi-sector request. */
+		while (i < cnt) {
+			cluster_t start = clst;
+			size_t run = 1;
+
+			while (i + run < cnt && (clst = fat_get (inode->fs, clst)) == start + run)
+				run++;
+			filesys_write_sectors (inode->fs->disk, cluster_to_sector (inode->fs, start),
+					run * SECTORS_PER_CLUSTER,
+					inode->delay + i * CLUSTER_SIZE);
+			i += run;
+		}
+		if (have == 0)
+			data->start = first;
+		if (inode->runs != NULL)
+			chain_cache_extend (inode, have, first, cnt);
+	}
+	if (inode->delay_cnt > cnt)
+		fat_unreserve (inode->fs, inode->delay_cnt - cnt);
+	if (inode->delay_length > data->length) {
+		data->length = inode->delay_length;
+		journal_write (inode->fs, inode->sector, data);
+	}
+
+	free (inode->delay);
+	inode->delay = NULL;
+	inode->delay_cnt = 0;
+}
+
+/* Discards INODE's delayed data, which is being removed. */
+static void
+delay_drop (struct inode *inode) {
+	if (inode->delay == NULL)
+		return;
+	fat_unreserve (inode->fs, inode->delay_cnt);
+	free (inode->delay);
+	inode->delay = NULL;
+	inode->delay_cnt = 0;
+}
+
+/* Copies up to SIZE bytes from BUFFER into INODE's delayed data
+ * at OFFSET, which must be at or past the first unallocated
+ * cluster and leave no gap after the end of file.  Returns the
+ * number of bytes taken, which is 0 if the buffer is full or
+ * memory or disk space runs out. */
+static off_t
+delay_put (struct inode *inode, const uint8_t *buffer, off_t size,
+		off_t offset) {
+	off_t base, end;
+	size_t need;
+
+	if (inode->delay == NULL) {
+		inode->delay = calloc (DELAY_MAX, CLUSTER_SIZE);
+		if (inode->delay == NULL)
+			return 0;
+		inode->delay_idx = bytes_to_clusters (inode->data.length);
+		inode->delay_cnt = 0;
+		inode->delay_length = inode->data.length;
+	}
+
+	base = inode->delay_idx * CLUSTER_SIZE;
+	ASSERT (offset >= base);
+	if (offset - base >= DELAY_MAX * CLUSTER_SIZE)
+		return 0;
+	if (size > base + DELAY_MAX * CLUSTER_SIZE - offset)
+		size = base + DELAY_MAX * CLUSTER_SIZE - offset;
+
+	end = offset + size > inode->delay_length ? offset + size
+		: inode->delay_length;
+	need = bytes_to_clusters (end) - inode->delay_idx;
+	if (need > inode->delay_cnt) {
+		if (!fat_reserve (inode->fs, need - inode->delay_cnt))
+			return 0;
+		inode->delay_cnt = need;
+	}
+	memcpy (inode->delay + (offset - base), buffer, size);
+	inode->delay_length = end;
+	return size;
+}
+#endif
+
+/* In-memory inodes, keyed by sector, so that opening a single
+ * inode twice returns the same `struct inode'.  Each file system
+ * has a table of its own.
+ *
+ * Besides the open inodes, a table keeps up to INODE_CACHE_MAX
+ * recently closed ones, so that reopening them (every exec,
+ * every open of a hot file) needs no disk read.  Closed inodes
+ * are always clean, because inode changes are written through,
+ * so they can be dropped at any time; those that were removed
+ * are freed right away instead.
+ *
+ * Disk I/O is done without INODE_LOCK held.  An inode that is
+ * being read in or written back stays in the table marked
+ * `loading' or `closing', and inode_open() waits on INODE_READY
+ * until it is done. */
+struct inode_table {
+	struct hash inodes;                 /* Open and recently closed inodes. */
+	struct list closed;                 /* Closed ones, most recent first. */
+	size_t closed_cnt;                  /* Length of CLOSED. */
+};
+
+/* Maximum length of an inode table's CLOSED list. */
+#define INODE_CACHE_MAX 64
+
+/* Protects every inode table and the open counts. */
+static struct lock inode_lock;
+
+/* Signaled when an inode stops loading or closing. */
+static struct condition inode_ready;
+
+static uint64_t inode_hash (const struct hash_elem *, void *);
+static bool inode_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static void inode_free (struct inode *);
+static off_t write_at (struct inode *, const void *, off_t size,
+		off_t offset);
+static off_t write_direct (struct inode *, const void *, off_t size,
+		off_t offset);
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	lock_init (&inode_lock);
+	cond_init (&inode_ready);
+}
+
+/* Creates the inode table of FS. */
+void
+inode_table_init (struct filesys *fs) {
+	struct inode_table *t = fs->inodes = malloc (sizeof *t);
+	if (t == NULL)
+		PANIC ("inode table creation failed");
+	hash_init (&t->inodes, inode_hash, inode_less, NULL);
+	list_init (&t->closed);
+	t->closed_cnt = 0;
+}
+
+/* Frees the inode table of FS, which is being unmounted, along
+ * with the closed inodes it still caches.  No inode of FS may
+ * be open. */
+void
+inode_table_destroy (struct filesys *fs) {
+	struct inode_table *t = fs->inodes;
+
+	lock_acquire (&inode_lock);
+	ASSERT (t->closed_cnt == hash_size (&t->inodes));
+	while (!list_empty (&t->closed)) {
+		struct inode *inode = list_entry (list_pop_front (&t->closed),
+				struct inode, lru_elem);
+		t->closed_cnt--;
+		hash_delete (&t->inodes, &inode->elem);
+		inode_free (inode);
+	}
+	lock_release (&inode_lock);
+	free (t);
+	fs->inodes = NULL;
+}
+
+/* Returns the number of inodes of FS that are open. */
+size_t
+inode_open_cnt (struct filesys *fs) {
+	struct inode_table *t = fs->inodes;
+	size_t cnt;
+
+	lock_acquire (&inode_lock);
+	cnt = hash_size (&t->inodes) - t->closed_cnt;
+	lock_release (&inode_lock);
+	return cnt;
+}
+
+/* Returns true if SECTOR of disk D holds an inode. */
+bool
+inode_probe (struct disk *d, disk_sector_t sector) {
+	struct inode_disk *data = malloc (sizeof *data);
+	bool found;
+
+	if (data == NULL)
+		return false;
+	filesys_read_sectors (d, sector, 1, data);
+	found = data->magic == INODE_MAGIC;
+	free (data);
+	return found;
+}
+
+/* Returns a hash value for inode E. */
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct inode *inode = hash_entry (e, struct inode, elem);
+	return hash_int (inode->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
- * writes the new inode to sector SECTOR on the file system
- * disk.
+ * writes the new inode to sector SECTOR of file system FS.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool
-inode_create (disk_sector_t sector, off_t length) {
+inode_create (struct filesys *fs, disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
 	bool success = false;
 
@@ -76,67 +867,122 @@ inode_create (disk_sector_t sector, off_t length) {
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
 	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
+	if (disk_inode != NULL && length <= INODE_INLINE_MAX) {
+		disk_inode->length = length;
+		disk_inode->magic = INODE_MAGIC;
+		disk_inode->flags = INODE_INLINE;
+		journal_write (fs, sector, disk_inode);
+		free (disk_inode);
+		success = true;
+	} else if (disk_inode != NULL) {
+#ifdef EFILESYS
+		size_t clusters = bytes_to_clusters (length);
+		disk_inode->length = length;
+		disk_inode->magic = INODE_MAGIC;
+		if (clusters > 0)
+			disk_inode->start = fat_extend_chain (fs, 0, clusters, true);
+		if (clusters == 0 || disk_inode->start != 0) {
+			journal_write (fs, sector, disk_inode);
+			success = true;
+		}
+#else
 		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		disk_inode->flags = INODE_LAZY;
+		if (free_map_allocate (fs, sectors, &disk_inode->start)) {
+			journal_write (fs, sector, disk_inode);
+			success = true;
+		}
+#endif
 		free (disk_inode);
 	}
 	return success;
 }
 
-/* Reads an inode from SECTOR
+/* Reads an inode from SECTOR of file system FS
  * and returns a `struct inode' that contains it.
  * Returns a null pointer if memory allocation fails. */
 struct inode *
-inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+inode_open (struct filesys *fs, disk_sector_t sector) {
+	static struct inode key;            /* Protected by INODE_LOCK. */
+	struct hash_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
+	/* Check whether this inode is already open or recently
+	 * closed, waiting out anyone reading it in or writing it
+	 * back. */
+	lock_acquire (&inode_lock);
+	for (;;) {
+		key.sector = sector;
+		e = hash_find (&fs->inodes->inodes, &key.elem);
+		if (e == NULL)
+			break;
+		inode = hash_entry (e, struct inode, elem);
+		if (inode->loading || inode->closing) {
+			cond_wait (&inode_ready, &inode_lock);
+			continue;
+		}
+		if (inode->open_cnt++ == 0) {
+			list_remove (&inode->lru_elem);
+			fs->inodes->closed_cnt--;
 		}
+		lock_release (&inode_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&inode_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	inode->fs = fs;
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->loading = true;
+	inode->closing = false;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->metadata = false;
+#ifdef EFILESYS
+	inode->runs = NULL;
+	inode->run_cnt = inode->run_cap = 0;
+	inode->delay = NULL;
+	inode->delay_idx = inode->delay_cnt = 0;
+	inode->delay_length = 0;
+#endif
+	hash_insert (&fs->inodes->inodes, &inode->elem);
+	lock_release (&inode_lock);
+
+	journal_read (inode->fs, inode->sector, &inode->data);
+
+	lock_acquire (&inode_lock);
+	inode->loading = false;
+	cond_broadcast (&inode_ready, &inode_lock);
+	lock_release (&inode_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&inode_lock);
 		inode->open_cnt++;
+		lock_release (&inode_lock);
+	}
 	return inode;
 }
 
+/* Returns the file system INODE belongs to. */
+struct filesys *
+inode_get_fs (const struct inode *inode) {
+	return inode->fs;
+}
+
 /* Returns INODE's inode number. */
 disk_sector_t
 inode_get_inumber (const struct inode *inode) {
@@ -153,19 +999,76 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+	struct filesys *fs = inode->fs;
+	struct inode_table *t = fs->inodes;
+	struct inode *victim = NULL;
+	journal_begin (fs);
+	lock_acquire (&inode_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&inode_lock);
+		journal_end (fs);
+		return;
+	}
+	inode->closing = true;
+	lock_release (&inode_lock);
+
+#ifdef EFILESYS
+	if (inode->removed)
+		delay_drop (inode);
+	else
+		delay_flush (inode);
+#endif
+
+	lock_acquire (&inode_lock);
+	inode->closing = false;
+	if (inode->removed) {
+		/* Remove from inode table, then free its blocks below. */
+		hash_delete (&t->inodes, &inode->elem);
+		victim = inode;
+	} else {
+		/* Keep it around for a later open. */
+		list_push_front (&t->closed, &inode->lru_elem);
+		if (++t->closed_cnt > INODE_CACHE_MAX) {
+			victim = list_entry (list_pop_back (&t->closed), struct inode,
+					lru_elem);
+			t->closed_cnt--;
+			hash_delete (&t->inodes, &victim->elem);
 		}
+	}
+	cond_broadcast (&inode_ready, &inode_lock);
+	lock_release (&inode_lock);
+
+	if (victim != NULL)
+		inode_free (victim);
+	journal_end (fs);
+}
+
+/* Frees INODE, which has no openers and is no longer in the
+ * inode table.  If INODE was removed, frees its blocks too. */
+static void
+inode_free (struct inode *inode) {
+	ASSERT (inode->open_cnt == 0);
 
-		free (inode); 
+	/* Deallocate blocks if removed, first dropping any pending
+	 * journal writes to them. */
+	if (inode->removed) {
+		inode_revoke (inode);
+#ifdef EFILESYS
+		fat_remove_chain (inode->fs, sector_to_cluster (inode->fs, inode->sector), 0);
+		if (!is_inline (&inode->data) && inode->data.start != 0)
+			fat_remove_chain (inode->fs, inode->data.start, 0);
+#else
+		free_map_release (inode->fs, inode->sector, 1);
+		if (!is_inline (&inode->data))
+			free_map_release (inode->fs, inode->data.start,
+					bytes_to_sectors (inode->data.length));
+#endif
 	}
+
+#ifdef EFILESYS
+	chain_cache_invalidate (inode);
+#endif
+	free (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -185,6 +1088,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
 
+	if (is_inline (&inode->data)) {
+		off_t inode_left = inode->data.length - offset;
+		if (size > inode_left)
+			size = inode_left;
+		if (size <= 0)
+			return 0;
+		memcpy (buffer, inode->data.inline_data + offset, size);
+		return size;
+	}
+
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -200,9 +1113,21 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
+#ifdef EFILESYS
+		if (inode->delay != NULL
+				&& offset >= (off_t) (inode->delay_idx * CLUSTER_SIZE)) {
+			/* Not yet placed on disk. */
+			memcpy (buffer + bytes_read,
+					inode->delay + (offset - inode->delay_idx * CLUSTER_SIZE),
+					chunk_size);
+		} else
+#endif
+		if (sector_unwritten (inode, offset)) {
+			/* Never written: reads as zeros. */
+			memset (buffer + bytes_read, 0, chunk_size);
+		} else if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+			journal_read (inode->fs, sector_idx, buffer + bytes_read);
 		} else {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
@@ -211,7 +1136,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 				if (bounce == NULL)
 					break;
 			}
-			disk_read (filesys_disk, sector_idx, bounce);
+			journal_read (inode->fs, sector_idx, bounce);
 			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
 		}
 
@@ -228,19 +1153,114 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
  * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * On the FAT file system a write past end of file extends the
+ * inode; the original file system cannot grow files. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_written;
+
+	if (inode->deny_write_cnt)
+		return 0;
+
+	/* The write and the metadata it changes commit together. */
+	journal_begin (inode->fs);
+	bytes_written = write_at (inode, buffer, size, offset);
+	journal_end (inode->fs);
+	return bytes_written;
+}
+
+/* Does the work of inode_write_at(), sending appends to regular
+ * files on the FAT file system through delayed allocation. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+#ifdef EFILESYS
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
+	while (size > 0) {
+		off_t alloc_end, chunk;
+
+		/* A write leaving a gap after the end of file makes a
+		 * hole; place what is buffered first. */
+		if (is_inline (&inode->data) || inode->metadata
+				|| offset > inode_length (inode)) {
+			delay_flush (inode);
+			break;
+		}
+
+		alloc_end = (inode->delay != NULL ? inode->delay_idx
+				: bytes_to_clusters (inode->data.length)) * CLUSTER_SIZE;
+		if (offset < alloc_end) {
+			/* Allocated clusters are written in place. */
+			chunk = size < alloc_end - offset ? size : alloc_end - offset;
+			chunk = write_direct (inode, buffer, chunk, offset);
+		} else {
+			chunk = delay_put (inode, buffer, size, offset);
+			if (chunk == 0 && inode->delay != NULL) {
+				/* Buffer full, or out of space: place it and retry,
+				 * writing directly if that does not help. */
+				delay_flush (inode);
+				chunk = delay_put (inode, buffer, size, offset);
+			}
+			if (chunk == 0)
+				break;
+		}
+		if (chunk == 0)
+			return bytes_written;
+
+		size -= chunk;
+		offset += chunk;
+		buffer += chunk;
+		bytes_written += chunk;
+	}
+	if (size > 0)
+		bytes_written += write_direct (inode, buffer, size, offset);
+	return bytes_written;
+#else
+	return write_direct (inode, buffer_, size, offset);
+#endif
+}
+
+/* Writes SIZE bytes from BUFFER into INODE at OFFSET in place,
+ * allocating what is missing right away. */
+static off_t
+write_direct (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
 	uint8_t *bounce = NULL;
+#ifndef EFILESYS
+	bool marked = false;                /* Unwritten marks changed? */
+#endif
 
-	if (inode->deny_write_cnt)
-		return 0;
+#ifdef EFILESYS
+	/* If the disk is full, write whatever fits in the current
+	 * length. */
+	if (size > 0 && offset + size > inode->data.length)
+		inode_grow (inode, offset, offset + size);
+#endif
+
+	if (is_inline (&inode->data)) {
+		off_t inode_left = inode->data.length - offset;
+		if (size > inode_left)
+			size = inode_left;
+		if (size <= 0)
+			return 0;
+		memcpy (inode->data.inline_data + offset, buffer, size);
+		journal_write (inode->fs, inode->sector, &inode->data);
+		return size;
+	}
 
 	while (size > 0) {
+#ifdef EFILESYS
+		/* Allocate a cluster first if the write lands in a hole. */
+		if (offset < inode->data.length
+				&& !inode_fill_hole (inode, offset / CLUSTER_SIZE))
+			break;
+#endif
+
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
@@ -252,12 +1272,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
 		/* Number of bytes to actually write into this sector. */
 		int chunk_size = size < min_left ? size : min_left;
+		bool fresh;
 		if (chunk_size <= 0)
 			break;
 
+		fresh = sector_unwritten (inode, offset);
+
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+			data_write (inode, sector_idx, buffer + bytes_written);
 		} else {
 			/* We need a bounce buffer. */
 			if (bounce == NULL) {
@@ -268,13 +1291,20 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
 			/* If the sector contains data before or after the chunk
 			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
+			   first.  Otherwise, or if it was never written, we
+			   start with a sector of all zeros. */
+			if (!fresh && (sector_ofs > 0 || chunk_size < sector_left))
+				journal_read (inode->fs, sector_idx, bounce);
 			else
 				memset (bounce, 0, DISK_SECTOR_SIZE);
 			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+			data_write (inode, sector_idx, bounce);
+		}
+		if (fresh) {
+			sector_written (inode, offset);
+#ifndef EFILESYS
+			marked = true;
+#endif
 		}
 
 		/* Advance. */
@@ -283,6 +1313,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		bytes_written += chunk_size;
 	}
 	free (bounce);
+#ifndef EFILESYS
+	if (marked)
+		journal_write (inode->fs, inode->sector, &inode->data);
+#endif
 
 	return bytes_written;
 }
@@ -309,5 +1343,101 @@ inode_allow_write (struct inode *inode) {
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
+#ifdef EFILESYS
+	if (inode->delay != NULL && inode->delay_length > inode->data.length)
+		return inode->delay_length;
+#endif
 	return inode->data.length;
 }
+
+/* Writes back INODE's delayed data, if any, and commits the
+ * journal, so that everything written to INODE so far survives
+ * a crash. */
+void
+inode_sync (struct inode *inode) {
+	journal_begin (inode->fs);
+#ifdef EFILESYS
+	delay_flush (inode);
+#endif
+	journal_end (inode->fs);
+	journal_commit (inode->fs);
+}
+
+/* Returns the number of disk sectors allocated to INODE's data.
+ * This is less than its length calls for if INODE is stored
+ * inline or has holes. */
+size_t
+inode_blocks (const struct inode *inode) {
+	const struct inode_disk *data = &inode->data;
+
+	if (is_inline (data))
+		return 0;
+#ifdef EFILESYS
+	size_t clusters = bytes_to_clusters (data->length);
+	uint32_t i;
+
+	for (i = 0; i < data->hole_cnt; i++)
+		clusters -= data->holes[i].cnt;
+	return (clusters + inode->delay_cnt) * SECTORS_PER_CLUSTER;
+#else
+	return bytes_to_sectors (data->length);
+#endif
+}
+
+/* Stores into EXTENTS, in file order, the runs of consecutive
+ * sectors of INODE's disk (see inode_get_fs()) that hold its
+ * data, and returns how many it stored.  Delayed data is written
+ * back first, so the map stays valid for as long as INODE's data
+ * is neither written nor resized.  Returns 0 if INODE is stored
+ * inline, has holes, or needs more than MAX extents. */
+size_t
+inode_extents (struct inode *inode, struct inode_extent *extents,
+		size_t max) {
+	const struct inode_disk *data = &inode->data;
+	size_t sectors, cnt = 0;
+
+	if (is_inline (data) || max == 0)
+		return 0;
+#ifdef EFILESYS
+	size_t i;
+
+	journal_begin (inode->fs);
+	delay_flush (inode);
+	journal_end (inode->fs);
+
+	if (data->hole_cnt > 0)
+		return 0;
+	if (inode->runs == NULL)
+		chain_walk (inode, 0, true);
+	if (inode->runs == NULL || inode->run_cnt > max)
+		return 0;
+
+	sectors = 0;
+	for (i = 0; i < inode->run_cnt; i++) {
+		const struct cluster_run *run = &inode->runs[i];
+		extents[cnt++] = (struct inode_extent) {
+			.start = cluster_to_sector (inode->fs, run->start),
+			.cnt = run->cnt * SECTORS_PER_CLUSTER,
+		};
+		sectors += run->cnt * SECTORS_PER_CLUSTER;
+	}
+	if (sectors < bytes_to_sectors (data->length))
+		return 0;
+#else
+	sectors = bytes_to_sectors (data->length);
+	if (sectors > 0)
+		extents[cnt++] = (struct inode_extent) {
+			.start = data->start,
+			.cnt = sectors,
+		};
+#endif
+	return cnt;
+}
+
+/* Marks INODE as holding file system metadata, such as a
+ * directory or the free map, so that its data is written
+ * through the journal. */
+void
+inode_set_metadata (struct inode *inode) {
+	inode->metadata = true;
+}
@@ -0,0 +1,501 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#endif
+
+/* Write-ahead metadata journal.
+ *
+ * Metadata blocks -- inode sectors, directory and free map data,
+ * and on the FAT file system the table itself -- are not written
+ * in place.  journal_write() puts them in the running transaction
+ * in memory, where later writes to the same sector replace the
+ * earlier copy and reads find the newest one.  A commit writes
+ * the transaction's blocks to the journal region, then the
+ * header that lists their home sectors, which is the commit
+ * point, and only then writes them home and clears the header.
+ * After a crash, journal_init() finds a committed header and
+ * copies its blocks home again, so mounting costs time
+ * proportional to the journal, not to the disk.  Each mounted
+ * file system has a journal of its own.
+ *
+ * File system operations run between journal_begin() and
+ * journal_end(), and a commit only happens when none is in
+ * progress, so each commit captures whole operations.  Commits
+ * are grouped: journal_end() commits once the transaction is
+ * half full, and a daemon commits whatever is pending every
+ * JOURNAL_INTERVAL.  Once the transaction is half full, new
+ * operations wait in journal_begin() until it has been
+ * committed, which leaves the other half for the operations in
+ * progress.  Only if they overflow it anyway, which in practice
+ * takes a single operation too large for the journal, is the
+ * transaction committed in the middle of them.
+ *
+ * A commit detaches the transaction before its disk I/O and
+ * releases the journal's lock meanwhile, so that operations and
+ * reads go on; until its blocks are home, reads find them in the
+ * committing transaction.  Only one commit runs at a time. */
+
+/* Identifies a committed journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Home sectors listed in the header and in the descriptor. */
+#define JOURNAL_HEAD_CNT ((DISK_SECTOR_SIZE - 8) / sizeof (disk_sector_t))
+#define JOURNAL_DESC_CNT (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* Maximum number of blocks in one transaction. */
+#define JOURNAL_MAX (JOURNAL_SECTORS - 2)
+
+/* Number of blocks past which new operations wait for a
+ * commit. */
+#define JOURNAL_FULL (JOURNAL_MAX / 2)
+
+/* Interval between group commits, in ms. */
+#define JOURNAL_INTERVAL 1000
+
+/* Journal header, at JOURNAL_SECTOR.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_head {
+	uint32_t magic;                     /* JOURNAL_MAGIC if committed. */
+	uint32_t cnt;                       /* Number of logged blocks. */
+	disk_sector_t home[JOURNAL_HEAD_CNT]; /* Home of the first blocks. */
+};
+
+/* A metadata block in the running or committing transaction. */
+struct journal_block {
+	struct hash_elem hash_elem;         /* Element in BLOCKS or COMMITTED. */
+	struct list_elem list_elem;         /* Element in ORDER. */
+	disk_sector_t sector;               /* Home sector. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Newest contents. */
+};
+
+/* The journal of one file system. */
+struct journal {
+	struct list_elem elem;              /* Element in JOURNALS. */
+	struct filesys *fs;                 /* File system it protects. */
+	struct hash blocks;                 /* Running transaction, by sector. */
+	struct list order;                  /* Same blocks, oldest first. */
+	size_t block_cnt;                   /* Number of blocks. */
+	struct hash committed;              /* Committing transaction, by sector. */
+	bool committing;                    /* Is a commit in progress? */
+	int active_cnt;                     /* Operations in progress. */
+	int stall_cnt;                      /* Of those, waiting for room. */
+	struct condition idle;              /* Signaled when ACTIVE_CNT drops
+	                                       or a commit finishes. */
+	struct journal_block key;           /* Lookup key for block_find(). */
+	struct lock lock;                   /* Protects all of the above. */
+};
+
+/* Journals of all mounted file systems, for the daemon. */
+static struct list journals;
+static struct lock journals_lock;
+
+static uint64_t block_hash (const struct hash_elem *, void *);
+static bool block_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static void block_free (struct hash_elem *, void *);
+static struct journal_block *block_find (struct journal *, struct hash *,
+		disk_sector_t);
+static void journal_replay (struct filesys *);
+static void make_room (struct journal *);
+static void journal_flush (struct journal *);
+static void do_commit (struct journal *);
+static void journal_daemon (void *);
+
+/* Initializes the journal module and starts the daemon that
+ * commits every journal periodically. */
+void
+journal_init (void) {
+	ASSERT (sizeof (struct journal_head) == DISK_SECTOR_SIZE);
+	ASSERT (JOURNAL_MAX <= JOURNAL_HEAD_CNT + JOURNAL_DESC_CNT);
+
+	list_init (&journals);
+	lock_init (&journals_lock);
+	thread_create ("journal", PRI_DEFAULT, journal_daemon, NULL);
+}
+
+/* Sets up the journal of FS.  Unless FORMAT, first replays any
+ * transaction that was committed but not yet written home. */
+void
+journal_open (struct filesys *fs, bool format) {
+	struct journal *j = fs->journal = calloc (1, sizeof *j);
+	struct journal_head *head;
+
+	if (j == NULL)
+		PANIC ("journal init failed");
+	j->fs = fs;
+	hash_init (&j->blocks, block_hash, block_less, NULL);
+	hash_init (&j->committed, block_hash, block_less, NULL);
+	list_init (&j->order);
+	lock_init (&j->lock);
+	cond_init (&j->idle);
+
+	if (format) {
+		head = calloc (1, sizeof *head);
+		if (head == NULL)
+			PANIC ("journal init failed");
+		filesys_write_sectors (fs->disk, JOURNAL_SECTOR, 1, head);
+		free (head);
+	} else
+		journal_replay (fs);
+
+	lock_acquire (&journals_lock);
+	list_push_back (&journals, &j->elem);
+	lock_release (&journals_lock);
+}
+
+/* Commits and frees the journal of FS, which is being unmounted.
+ * No operation may be in progress or start. */
+void
+journal_close (struct filesys *fs) {
+	struct journal *j = fs->journal;
+
+	lock_acquire (&journals_lock);
+	list_remove (&j->elem);
+	lock_release (&journals_lock);
+
+	journal_commit (fs);
+	ASSERT (j->block_cnt == 0 && !j->committing);
+	hash_destroy (&j->blocks, NULL);
+	hash_destroy (&j->committed, NULL);
+	free (j);
+	fs->journal = NULL;
+}
+
+/* Copies the blocks of a committed transaction to their home
+ * sectors of FS and clears the journal. */
+static void
+journal_replay (struct filesys *fs) {
+	struct journal_head *head = malloc (sizeof *head);
+	disk_sector_t *desc = malloc (DISK_SECTOR_SIZE);
+	uint8_t *buffer = malloc (DISK_SECTOR_SIZE);
+	size_t i;
+
+	if (head == NULL || desc == NULL || buffer == NULL)
+		PANIC ("journal replay failed");
+
+	filesys_read_sectors (fs->disk, JOURNAL_SECTOR, 1, head);
+	if (head->magic == JOURNAL_MAGIC && head->cnt > 0
+			&& head->cnt <= JOURNAL_MAX) {
+		if (head->cnt > JOURNAL_HEAD_CNT)
+			filesys_read_sectors (fs->disk, JOURNAL_SECTOR + 1, 1, desc);
+		for (i = 0; i < head->cnt; i++) {
+			disk_sector_t home = i < JOURNAL_HEAD_CNT
+				? head->home[i] : desc[i - JOURNAL_HEAD_CNT];
+			filesys_read_sectors (fs->disk, JOURNAL_SECTOR + 2 + i, 1,
+					buffer);
+			filesys_write_sectors (fs->disk, home, 1, buffer);
+		}
+		printf ("journal: replayed %"PRIu32" blocks\n", head->cnt);
+
+		head->cnt = 0;
+		filesys_write_sectors (fs->disk, JOURNAL_SECTOR, 1, head);
+	}
+
+	free (buffer);
+	free (desc);
+	free (head);
+}
+
+/* Starts an operation on file system FS.  Operations may
+ * nest.  An outermost operation first waits for a transaction
+ * that is half full to be committed. */
+void
+journal_begin (struct filesys *fs) {
+	struct journal *j = fs->journal;
+	struct thread *t = thread_current ();
+
+	lock_acquire (&j->lock);
+	if (t->journal_depth == 0)
+		while (j->block_cnt >= JOURNAL_FULL) {
+			if (j->active_cnt == 0 && !j->committing)
+				do_commit (j);
+			else
+				cond_wait (&j->idle, &j->lock);
+		}
+	t->journal_depth++;
+	j->active_cnt++;
+	lock_release (&j->lock);
+}
+
+/* Ends an operation on FS, committing the running transaction if
+ * it is the last one in progress and the transaction is half
+ * full. */
+void
+journal_end (struct filesys *fs) {
+	struct journal *j = fs->journal;
+
+	lock_acquire (&j->lock);
+	ASSERT (j->active_cnt > 0);
+	thread_current ()->journal_depth--;
+	j->active_cnt--;
+	cond_broadcast (&j->idle, &j->lock);
+	if (j->active_cnt == 0 && j->block_cnt >= JOURNAL_FULL
+			&& !j->committing)
+		do_commit (j);
+	lock_release (&j->lock);
+}
+
+/* Commits the running transaction of FS now, first waiting for
+ * the operations in progress in other threads to end and for any
+ * commit in progress to finish.  The caller must not be in an
+ * operation itself. */
+void
+journal_commit (struct filesys *fs) {
+	struct journal *j = fs->journal;
+
+	lock_acquire (&j->lock);
+	while (j->active_cnt > 0 || j->committing)
+		cond_wait (&j->idle, &j->lock);
+	do_commit (j);
+	lock_release (&j->lock);
+}
+
+/* Reads SECTOR of FS into BUFFER, from the running or committing
+ * transaction if either holds a newer copy than the disk. */
+void
+journal_read (struct filesys *fs, disk_sector_t sector, void *buffer) {
+	struct journal *j = fs->journal;
+	struct journal_block *b;
+
+	lock_acquire (&j->lock);
+	b = block_find (j, &j->blocks, sector);
+	if (b == NULL)
+		b = block_find (j, &j->committed, sector);
+	if (b != NULL)
+		memcpy (buffer, b->data, DISK_SECTOR_SIZE);
+	lock_release (&j->lock);
+	if (b == NULL)
+		filesys_read_sectors (fs->disk, sector, 1, buffer);
+}
+
+/* Logs BUFFER as the new contents of metadata sector SECTOR of
+ * FS in the running transaction.  May be called while
+ * committing, to add the FAT's dirty sectors. */
+void
+journal_write (struct filesys *fs, disk_sector_t sector,
+		const void *buffer) {
+	struct journal *j = fs->journal;
+	bool held = lock_held_by_current_thread (&j->lock);
+	struct journal_block *b;
+
+	if (!held)
+		lock_acquire (&j->lock);
+	b = block_find (j, &j->blocks, sector);
+	if (b == NULL) {
+		if (j->block_cnt == JOURNAL_MAX)
+			make_room (j);
+		b = malloc (sizeof *b);
+		if (b == NULL)
+			PANIC ("journal block allocation failed");
+		b->sector = sector;
+		hash_insert (&j->blocks, &b->hash_elem);
+		list_push_back (&j->order, &b->list_elem);
+		j->block_cnt++;
+	}
+	memcpy (b->data, buffer, DISK_SECTOR_SIZE);
+	if (!held)
+		lock_release (&j->lock);
+}
+
+/* Drops the CNT sectors of FS starting at SECTOR from the
+ * running transaction, because they have been freed.  Otherwise
+ * a commit could overwrite whatever they are reused for.  A
+ * commit in progress is let finish first, since its blocks can
+ * no longer be dropped. */
+void
+journal_revoke (struct filesys *fs, disk_sector_t sector, size_t cnt) {
+	struct journal *j = fs->journal;
+	struct list_elem *e;
+
+	lock_acquire (&j->lock);
+	while (j->committing)
+		cond_wait (&j->idle, &j->lock);
+	for (e = list_begin (&j->order); e != list_end (&j->order); ) {
+		struct journal_block *b = list_entry (e, struct journal_block,
+				list_elem);
+		e = list_next (e);
+		if (b->sector >= sector && b->sector - sector < cnt) {
+			list_remove (&b->list_elem);
+			hash_delete (&j->blocks, &b->hash_elem);
+			j->block_cnt--;
+			free (b);
+		}
+	}
+	lock_release (&j->lock);
+}
+
+/* Makes room in J's full transaction.  The operations in
+ * progress have filled it, so this waits until each of them has
+ * either ended or filled it as well -- usually the caller's own
+ * operation is the only one -- and then commits the transaction
+ * as it is, in the middle of those operations.  The caller must
+ * hold J's lock. */
+static void
+make_room (struct journal *j) {
+	int depth = thread_current ()->journal_depth;
+
+	j->stall_cnt += depth;
+	cond_broadcast (&j->idle, &j->lock);
+	while (j->block_cnt == JOURNAL_MAX
+			&& (j->active_cnt > j->stall_cnt || j->committing))
+		cond_wait (&j->idle, &j->lock);
+	if (j->block_cnt == JOURNAL_MAX)
+		journal_flush (j);
+	j->stall_cnt -= depth;
+	cond_broadcast (&j->idle, &j->lock);
+}
+
+/* Commits the running transaction of J, including the FAT
+ * sectors it dirtied.  The caller must hold J's lock. */
+static void
+do_commit (struct journal *j) {
+	ASSERT (lock_held_by_current_thread (&j->lock));
+#ifdef EFILESYS
+	fat_sync (j->fs);
+#endif
+	journal_flush (j);
+}
+
+/* Writes the running transaction of J to the journal, commits
+ * it, writes its blocks home and empties it.  The caller must
+ * hold J's lock and no commit may be in progress.  The
+ * transaction becomes the committing one and the lock is
+ * released for the disk I/O, then reacquired. */
+static void
+journal_flush (struct journal *j) {
+	struct disk *disk = j->fs->disk;
+	size_t cnt = j->block_cnt;
+	struct journal_head *head;
+	disk_sector_t *desc;
+	uint8_t *log;
+	struct hash empty;
+	struct list order;
+	struct list_elem *e;
+	size_t i;
+
+	ASSERT (!j->committing);
+	if (cnt == 0)
+		return;
+
+	head = calloc (1, sizeof *head);
+	desc = calloc (1, DISK_SECTOR_SIZE);
+	log = malloc (cnt * DISK_SECTOR_SIZE);
+	if (head == NULL || desc == NULL || log == NULL)
+		PANIC ("journal commit failed");
+
+	/* Detach the transaction.  Its blocks no longer change: writes
+	 * go to the new running transaction and revocations wait. */
+	list_init (&order);
+	while (!list_empty (&j->order))
+		list_push_back (&order, list_pop_front (&j->order));
+	empty = j->committed;
+	j->committed = j->blocks;
+	j->blocks = empty;
+	j->block_cnt = 0;
+	j->committing = true;
+	lock_release (&j->lock);
+
+	/* Log the blocks in one write, then their home sectors. */
+	for (i = 0, e = list_begin (&order); e != list_end (&order);
+			i++, e = list_next (e)) {
+		struct journal_block *b = list_entry (e, struct journal_block,
+				list_elem);
+		memcpy (log + i * DISK_SECTOR_SIZE, b->data, DISK_SECTOR_SIZE);
+		if (i < JOURNAL_HEAD_CNT)
+			head->home[i] = b->sector;
+		else
+			desc[i - JOURNAL_HEAD_CNT] = b->sector;
+	}
+	filesys_write_sectors (disk, JOURNAL_SECTOR + 2, cnt, log);
+	if (cnt > JOURNAL_HEAD_CNT)
+		filesys_write_sectors (disk, JOURNAL_SECTOR + 1, 1, desc);
+
+	/* Commit point: a single sector write is atomic. */
+	head->magic = JOURNAL_MAGIC;
+	head->cnt = cnt;
+	filesys_write_sectors (disk, JOURNAL_SECTOR, 1, head);
+
+	/* Checkpoint. */
+	for (e = list_begin (&order); e != list_end (&order);
+			e = list_next (e)) {
+		struct journal_block *b = list_entry (e, struct journal_block,
+				list_elem);
+		filesys_write_sectors (disk, b->sector, 1, b->data);
+	}
+	head->cnt = 0;
+	filesys_write_sectors (disk, JOURNAL_SECTOR, 1, head);
+
+	lock_acquire (&j->lock);
+	hash_clear (&j->committed, block_free);
+	j->committing = false;
+	cond_broadcast (&j->idle, &j->lock);
+
+	free (log);
+	free (desc);
+	free (head);
+}
+
+/* Daemon that commits the running transaction of each journal
+ * every JOURNAL_INTERVAL, unless operations are in progress. */
+static void
+journal_daemon (void *aux UNUSED) {
+	struct list_elem *e;
+
+	for (;;) {
+		timer_msleep (JOURNAL_INTERVAL);
+		lock_acquire (&journals_lock);
+		for (e = list_begin (&journals); e != list_end (&journals);
+				e = list_next (e)) {
+			struct journal *j = list_entry (e, struct journal, elem);
+			lock_acquire (&j->lock);
+			if (j->active_cnt == 0 && !j->committing)
+				do_commit (j);
+			lock_release (&j->lock);
+		}
+		lock_release (&journals_lock);
+	}
+}
+
+/* Returns the block for SECTOR in BLOCKS, which is one of J's
+ * transactions, or a null pointer.  The caller must hold J's
+ * lock, which also protects the lookup key; it lives in J to
+ * keep it off the kernel stack. */
+static struct journal_block *
+block_find (struct journal *j, struct hash *blocks, disk_sector_t sector) {
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&j->lock));
+	j->key.sector = sector;
+	e = hash_find (blocks, &j->key.hash_elem);
+	return e != NULL ? hash_entry (e, struct journal_block, hash_elem) : NULL;
+}
+
+/* Frees block E. */
+static void
+block_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct journal_block, hash_elem));
+}
+
+/* Returns a hash value for block E. */
+static uint64_t
+block_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct journal_block, hash_elem)->sector);
+}
+
+/* Returns true if block A precedes block B. */
+static bool
+block_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct journal_block, hash_elem)->sector
+		< hash_entry (b, struct journal_block, hash_elem)->sector;
+}
@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,13 +18,110 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Most sectors a single request may transfer.  The ATA sector
+ * count register is 8 bits wide, with 0 meaning 256. */
+#define DISK_MAX_SECTORS 256
+
+/* Where disk I/O comes from, for statistics.  Callers that know
+   pass it to disk_transfer(); otherwise a request's origin
+   defaults to the role of the disk it goes to (see disk_init()). */
+enum disk_origin {
+	DISK_ORIGIN_FILESYS,        /* File system. */
+	DISK_ORIGIN_SWAP,           /* Swapping. */
+	DISK_ORIGIN_SCRATCH,        /* Scratch disk. */
+	DISK_ORIGIN_OTHER,          /* Anything else. */
+	DISK_ORIGIN_CNT
+};
+
+/* Histogram sizes.  Bucket I of a size histogram counts requests
+   of 2**I to 2**(I+1) - 1 sectors.  Bucket I of a service time
+   histogram counts requests served in 2**I to 2**(I+1) - 1
+   microseconds, except that the first and last buckets also
+   count anything faster or slower, respectively. */
+#define DISK_SIZE_BUCKETS 9
+#define DISK_TIME_BUCKETS 20
+
+/* Statistics for the requests from one origin to one disk. */
+struct disk_stats {
+	long long requests;         /* Requests completed. */
+	long long bytes;            /* Bytes transferred. */
+	long long wait_us;          /* Microseconds queued, summed. */
+	long long service_us;       /* Microseconds from issue to
+								   completion, summed. */
+	long long size_hist[DISK_SIZE_BUCKETS];     /* By size. */
+	long long time_hist[DISK_TIME_BUCKETS];     /* By service time. */
+};
+
+/* Values readable through the disk statistics inspect interrupt
+   (see register_disk_inspect_intr()).  The histogram fields are
+   followed by their other buckets.  The queue depth fields cover
+   all origins. */
+enum disk_stat_field {
+	DISK_STAT_REQUESTS,
+	DISK_STAT_BYTES,
+	DISK_STAT_WAIT_US,
+	DISK_STAT_SERVICE_US,
+	DISK_STAT_SIZE_HIST,
+	DISK_STAT_TIME_HIST = DISK_STAT_SIZE_HIST + DISK_SIZE_BUCKETS,
+	DISK_STAT_DEPTH_AVG = DISK_STAT_TIME_HIST + DISK_TIME_BUCKETS,
+	                            /* Time-averaged, times 100. */
+	DISK_STAT_DEPTH_MAX,
+	DISK_STAT_FIELD_CNT
+};
+
+struct disk_request;
+
+/* Called from the disk interrupt handler when a request is
+   complete, with interrupts off.  Must not sleep. */
+typedef void disk_done_func (struct disk_request *);
+
+/* An asynchronous request to transfer a run of consecutive
+   sectors.  Set it up with disk_request_init() and pass it to
+   disk_submit().  It must stay allocated until its DONE function
+   has been called. */
+struct disk_request {
+	struct list_elem elem;      /* Element in the channel's queue. */
+	struct disk *disk;          /* Disk to access. */
+	disk_sector_t sec_no;       /* First sector to transfer. */
+	size_t cnt;                 /* Number of sectors, 1...DISK_MAX_SECTORS. */
+	void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes of
+								   kernel memory. */
+	bool write;                 /* True to write, false to read. */
+	disk_done_func *done;       /* Completion callback. */
+	void *aux;                  /* For use by DONE. */
+	enum disk_origin origin;    /* Who it is for, for statistics. */
+
+	/* Owned by the driver from submission to completion.  Times
+	   are in microseconds. */
+	struct list_elem fifo_elem; /* Element in the scheduler's FIFO. */
+	uint64_t submitted;         /* Time it was submitted. */
+	uint64_t deadline;          /* Time by which it should start. */
+	struct disk_request *next;  /* Next request merged into the disk
+								   command this one belongs to. */
+	size_t run_cnt;             /* Sectors in the command this request
+								   heads. */
+	size_t xfer;                /* Sectors of that command transferred
+								   so far. */
+};
+
 void disk_init (void);
+bool disk_set_scheduler (const char *name);
 void disk_print_stats (void);
+void disk_get_stats (struct disk *, enum disk_origin, struct disk_stats *);
 
 struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multi (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multi (struct disk *, disk_sector_t, size_t cnt,
+		const void *);
+void disk_transfer (struct disk *, disk_sector_t, size_t cnt, void *,
+		bool write, enum disk_origin);
+
+void disk_request_init (struct disk_request *, struct disk *, disk_sector_t,
+		size_t cnt, void *buffer, bool write, disk_done_func *, void *aux);
+void disk_submit (struct disk_request *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
@@ -0,0 +1,26 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Result of a dentry cache lookup. */
+enum dcache_result {
+	DCACHE_MISS,                /* Nothing known; ask the directory. */
+	DCACHE_HIT,                 /* Name exists; child sector returned. */
+	DCACHE_NEGATIVE             /* Name is known not to exist. */
+};
+
+struct filesys;
+
+void dcache_init (struct filesys *);
+void dcache_destroy (struct filesys *);
+enum dcache_result dcache_lookup (struct filesys *, disk_sector_t parent,
+                                  const char *name, disk_sector_t *child);
+void dcache_insert (struct filesys *, disk_sector_t parent, const char *name,
+                    disk_sector_t child);
+void dcache_insert_negative (struct filesys *, disk_sector_t parent,
+                             const char *name);
+void dcache_purge_dir (struct filesys *, disk_sector_t parent);
+
+#endif /* filesys/dcache.h */
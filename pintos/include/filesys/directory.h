@@ -12,11 +12,12 @@
 #define NAME_MAX 14
 
 struct inode;
+struct filesys;
 
 /* Opening and closing directories. */
-bool dir_create (disk_sector_t sector, size_t entry_cnt);
+bool dir_create (struct filesys *, disk_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
-struct dir *dir_open_root (void);
+struct dir *dir_open_root (struct filesys *);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -26,6 +27,8 @@ void file_allow_write (struct file *);
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
+void file_sync (struct file *);
+size_t file_blocks (struct file *);
 
 void file_add_ref(struct file *);
 int file_get_ref_count(struct file *);
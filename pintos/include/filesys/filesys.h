@@ -2,19 +2,56 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include "devices/disk.h"
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#define ROOT_DIR_SECTOR(FS) cluster_to_sector (FS, ROOT_DIR_CLUSTER)
+#define JOURNAL_SECTOR 1        /* First sector of the journal. */
+#else
+#define ROOT_DIR_SECTOR(FS) 1   /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* First sector of the journal. */
+#endif
 
-/* Disk used for file system. */
+/* Longest path name, including the null terminator. */
+#define PATH_MAX 128
+
+/* A file system on one disk.
+ *
+ * The root file system lives on filesys_disk; filesys_mount()
+ * attaches the file systems of other disks under names in the
+ * root directory of an already mounted one.  Each has its own
+ * allocation map, journal, inode table and dentry cache, so
+ * file systems on different channels do their I/O in
+ * parallel. */
+struct filesys {
+	struct disk *disk;                  /* Disk it lives on. */
+	struct journal *journal;            /* Metadata journal. */
+	struct fat_fs *fat;                 /* File allocation table (EFILESYS). */
+	struct free_map *free_map;          /* Free sector map (otherwise). */
+	struct inode_table *inodes;         /* In-memory inodes. */
+	struct dcache *dcache;              /* Dentry cache. */
+};
+
+/* Disk used for the root file system. */
 extern struct disk *filesys_disk;
 
+/* The root file system. */
+extern struct filesys *root_fs;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_mount (const char *path, int chan_no, int dev_no);
+bool filesys_umount (const char *path);
+void filesys_read_sectors (struct disk *, disk_sector_t, size_t cnt,
+		void *);
+void filesys_write_sectors (struct disk *, disk_sector_t, size_t cnt,
+		const void *);
 
 #endif /* filesys/filesys.h */
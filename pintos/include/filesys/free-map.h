@@ -5,13 +5,15 @@
 #include <stddef.h>
 #include "devices/disk.h"
 
-void free_map_init (void);
-void free_map_read (void);
-void free_map_create (void);
-void free_map_open (void);
-void free_map_close (void);
+struct filesys;
 
-bool free_map_allocate (size_t, disk_sector_t *);
-void free_map_release (disk_sector_t, size_t);
+void free_map_init (struct filesys *);
+void free_map_create (struct filesys *);
+bool free_map_open (struct filesys *);
+void free_map_close (struct filesys *);
+void free_map_destroy (struct filesys *);
+
+bool free_map_allocate (struct filesys *, size_t, disk_sector_t *);
+void free_map_release (struct filesys *, disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -2,15 +2,28 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 
 struct bitmap;
+struct filesys;
+
+/* A run of consecutive disk sectors holding part of a file. */
+struct inode_extent {
+	disk_sector_t start;                /* First sector. */
+	size_t cnt;                         /* Number of sectors. */
+};
 
 void inode_init (void);
-bool inode_create (disk_sector_t, off_t);
-struct inode *inode_open (disk_sector_t);
+void inode_table_init (struct filesys *);
+void inode_table_destroy (struct filesys *);
+size_t inode_open_cnt (struct filesys *);
+bool inode_probe (struct disk *, disk_sector_t);
+bool inode_create (struct filesys *, disk_sector_t, off_t);
+struct inode *inode_open (struct filesys *, disk_sector_t);
 struct inode *inode_reopen (struct inode *);
+struct filesys *inode_get_fs (const struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
@@ -19,5 +32,9 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+size_t inode_blocks (const struct inode *);
+void inode_sync (struct inode *);
+size_t inode_extents (struct inode *, struct inode_extent *, size_t max);
+void inode_set_metadata (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,26 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+struct filesys;
+
+/* Size of the journal region, which starts at JOURNAL_SECTOR
+ * (see filesys.h): a header, one descriptor sector and up to
+ * JOURNAL_SECTORS - 2 logged blocks. */
+#define JOURNAL_SECTORS 256
+
+void journal_init (void);
+void journal_open (struct filesys *, bool format);
+void journal_close (struct filesys *);
+void journal_begin (struct filesys *);
+void journal_end (struct filesys *);
+void journal_commit (struct filesys *);
+
+void journal_read (struct filesys *, disk_sector_t, void *);
+void journal_write (struct filesys *, disk_sector_t, const void *);
+void journal_revoke (struct filesys *, disk_sector_t, size_t cnt);
+
+#endif /* filesys/journal.h */
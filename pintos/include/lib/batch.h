@@ -0,0 +1,21 @@
+#ifndef __LIB_BATCH_H
+#define __LIB_BATCH_H
+
+#include <stdint.h>
+
+/* Batched system calls, shared between user programs and the
+   kernel. */
+
+/* One system call in a batch(): NR and up to six ARGS in, the
+   call's return value out in RET. */
+struct syscall_rec
+  {
+    uint64_t nr;                /* System call number (SYS_*). */
+    uint64_t args[6];           /* Arguments, in order. */
+    int64_t ret;                /* Set by the kernel. */
+  };
+
+/* Maximum number of records in one batch(). */
+#define BATCH_MAX 64
+
+#endif /* lib/batch.h */
@@ -0,0 +1,69 @@
+#ifndef __LIB_IO_RING_H
+#define __LIB_IO_RING_H
+
+#include <stdint.h>
+
+/* Asynchronous I/O rings, shared between a user process and the
+   kernel.
+
+   A process maps one ring page with io_setup().  To queue a
+   request it fills in sq[sq_tail % entries] and advances sq_tail;
+   io_enter() hands the queued requests to kernel worker threads
+   and optionally waits for completions.  Each finished request
+   produces one entry at cq[cq_tail % entries]; the process reads
+   entries from cq_head and advances cq_head past them.
+
+   The kernel writes only sq_head and cq_tail, the process only
+   sq_tail and cq_head. */
+
+/* Request opcodes. */
+enum io_op
+  {
+    IO_NOP,                     /* Does nothing; completes with 0. */
+    IO_READ,                    /* read() at the file position. */
+    IO_WRITE,                   /* write() at the file position. */
+    IO_PREAD,                   /* Read at OFF. */
+    IO_PWRITE,                  /* Write at OFF. */
+    IO_FSYNC                    /* Make the file's data durable. */
+  };
+
+/* Submission queue entry. */
+struct io_sqe
+  {
+    uint8_t op;                 /* One of enum io_op. */
+    uint8_t pad[3];
+    int32_t fd;                 /* File descriptor. */
+    void *buf;                  /* Data buffer. */
+    uint32_t len;               /* Bytes to transfer. */
+    int32_t off;                /* File offset for IO_PREAD/IO_PWRITE. */
+    uint64_t user_data;         /* Copied to the completion. */
+  };
+
+/* Completion queue entry. */
+struct io_cqe
+  {
+    uint64_t user_data;         /* From the submission. */
+    int32_t res;                /* Result, as the synchronous call. */
+    uint32_t pad;
+  };
+
+/* Maximum entries in each queue.  The whole ring fits in a page. */
+#define IO_RING_MAX 64
+
+/* Largest buffer one request may transfer. */
+#define IO_LEN_MAX (256 * 1024)
+
+/* The shared ring page. */
+struct io_ring
+  {
+    uint32_t sq_head;           /* Next entry the kernel takes. */
+    uint32_t sq_tail;           /* Next entry the process fills. */
+    uint32_t cq_head;           /* Next completion the process reads. */
+    uint32_t cq_tail;           /* Next completion the kernel writes. */
+    uint32_t entries;           /* Queue size, a power of 2. */
+    uint32_t pad[3];
+    struct io_sqe sq[IO_RING_MAX];
+    struct io_cqe cq[IO_RING_MAX];
+  };
+
+#endif /* lib/io-ring.h */
@@ -36,6 +36,16 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_FILEBLOCKS,             /* Obtain a file's allocated sectors. */
+	SYS_PREAD,                  /* Read from a file at an offset. */
+	SYS_PWRITE,                 /* Write to a file at an offset. */
+	SYS_READV,                  /* Read into several buffers. */
+	SYS_WRITEV,                 /* Write from several buffers. */
+	SYS_COPY_FILE_RANGE,        /* Copy data between files. */
+	SYS_IO_SETUP,               /* Map an asynchronous I/O ring. */
+	SYS_IO_ENTER,               /* Submit and wait for ring requests. */
+	SYS_BATCH,                  /* Run several system calls at once. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <batch.h>
+#include <io-ring.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -30,11 +34,21 @@ bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
 int filesize (int fd);
+int fileblocks (int fd);
 int read (int fd, void *buffer, unsigned length);
 int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, off_t off_in, int fd_out, off_t off_out,
+                     unsigned length);
+int io_setup (struct io_ring *ring, unsigned entries);
+int io_enter (unsigned to_submit, unsigned min_complete);
+int batch (struct syscall_rec *recs, int cnt, bool stop_on_error);
 
 int dup2(int oldfd, int newfd);
 
@@ -49,6 +63,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
+int mount (const char *path, int chan_no, int dev_no);
+int umount (const char *path);
 
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
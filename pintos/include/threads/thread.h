@@ -109,6 +109,7 @@ struct thread {
   /* Shared between thread.c and synch.c. */
   struct list_elem elem; /* List element. */
   void *user_rsp; // syscall 시작 시점의 rsp
+  int journal_depth; // 진행 중인 파일 시스템 연산의 중첩 수 (filesys/journal.c)
 
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
@@ -125,6 +126,9 @@ struct thread {
 
   // rox(read only executable)를 위해, 스레드가 실행 중인 파일 정보를 저장
   struct file *running_file;
+
+  struct aio_ctx *aio;  // 비동기 I/O 링 (userprog/aio.c), 없으면 NULL
+  void *batch;          // 실행 중인 batch()의 버퍼 (userprog/syscall.c), 없으면 NULL
 #endif
 #ifdef VM
   /* Table for whole virtual memory owned by thread. */
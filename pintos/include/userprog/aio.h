@@ -0,0 +1,9 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+int aio_setup(void* addr, unsigned entries);
+int aio_enter(unsigned to_submit, unsigned min_complete);
+void aio_drain(void);
+void aio_destroy(void);
+
+#endif /* userprog/aio.h */
@@ -1,5 +1,9 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
+#include <stddef.h>
+#include <stdint.h>
+#include <batch.h>
+#include <uio.h>
 #include "threads/synch.h"
 extern struct lock filesys_lock;
 
@@ -0,0 +1,23 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* 유저 메모리를 직접 읽고 쓰는 함수들.
+ * 페이지 폴트는 VM이 처리하고, 처리할 수 없는 폴트는 예외 테이블을 통해
+ * 실패로 돌아온다. filesys_lock을 잡은 채로 부르면 안 된다. */
+bool copy_from_user(void* dst, const void* usrc, size_t size);
+bool copy_to_user(void* udst, const void* src, size_t size);
+long strncpy_from_user(char* dst, const char* usrc, size_t size);
+
+/* 예외 테이블의 한 항목: insn에서 폴트가 나면 fixup으로 이어서 실행한다. */
+struct exception_entry {
+  uintptr_t insn;
+  uintptr_t fixup;
+};
+
+struct intr_frame;
+bool exception_fixup(struct intr_frame* f);
+
+#endif /* userprog/uaccess.h */
@@ -1,23 +1,55 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <list.h>
 #include "devices/disk.h"
 #include "vm/vm.h"
 
 struct page;
 enum vm_type;
+struct swap_device;
 
 struct anon_page {
-  struct swap_anon *swap_anon;
+  struct swap_device *swap_dev;  // swap out된 장치, 메모리에 있으면 NULL
+  size_t swap_slot;              // swap_dev 안의 slot 번호
 };
 
-struct swap_anon {
-  bool use;  // 스왑 공간을 사용하고 있는지 여부
-  disk_sector_t sector[8];
-  struct page *page;
-  struct list_elem swap_elem;
+/* swap 장치가 한 페이지 크기의 slot을 읽고 쓰는 방법 */
+struct swap_device_ops {
+  bool (*read)(struct swap_device *dev, size_t slot, void *kva);
+  bool (*write)(struct swap_device *dev, size_t slot, const void *kva);
+};
+
+/* swap 장치 하나.
+  priority가 높은 장치부터 쓰고, priority가 같은 장치들 사이에서는
+  slot을 round-robin으로 번갈아 나눠 준다.
+  swap I/O는 축출 한 번에 페이지 하나씩 동기적으로 하므로 한 축출이 여러
+  장치를 동시에 쓰지는 않는다. 장치들이 서로 다른 채널에 있으면 (예: hd0:1의
+  swap 파일과 hd1:1) 여러 스레드의 축출이 겹쳐 진행될 수 있지만, 한 채널은
+  명령을 하나씩만 처리하므로 같은 채널의 장치끼리는 겹치지 않는다. */
+struct swap_device {
+  struct list_elem elem;  // swap_devices의 원소 (priority 내림차순)
+  char name[16];
+  const struct swap_device_ops *ops;
+  void *aux;              // ops가 쓰는 장치별 데이터
+  size_t slot_cnt;
+  struct bitmap *used;    // slot별 사용 여부
+  size_t used_cnt;
+  int priority;
+
+  /* 통계 */
+  long long swap_outs;    // 쓴 페이지 수
+  long long swap_ins;     // 읽은 페이지 수
+  uint64_t io_us;         // 읽기/쓰기에 걸린 시간의 합 (microsecond)
 };
 
 void vm_anon_init(void);
 bool anon_initializer(struct page *page, enum vm_type type, void *kva);
 
+struct swap_device *swap_add_device(const char *name, const struct swap_device_ops *ops,
+                                    void *aux, size_t slot_cnt, int priority);
+bool swap_parse_option(const char *option);
+bool swap_parse_file_option(const char *option);
+bool swap_uses_disk(struct disk *d);
+void swap_print_stats(void);
+
 #endif
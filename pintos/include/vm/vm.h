@@ -70,7 +70,8 @@ struct frame {
   void *kva;                    // 커널 가상 주소 (실제 물리 메모리를 가리킴)
   struct page *page;            // 이 프레임을 사용하는 페이지
   struct list_elem frame_elem;  // frame_table에 들어갈 때 사용
-  bool pinned;
+  bool pinned;                  // 적재/축출 중이라 건드리면 안 되는 프레임
+  int pin_cnt;                  // 시스템 콜 I/O가 고정한 횟수 (vm_pin_buffer)
 };
 
 /* The function table for page operations.
@@ -126,6 +127,8 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void *upage,
                                     bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page(struct page *page);
 bool vm_claim_page(void *va);
+bool vm_pin_buffer(const void *buffer, size_t size, bool write);
+void vm_unpin_buffer(const void *buffer, size_t size);
 enum vm_type page_get_type(struct page *page);
 
 uint64_t page_hash(const struct hash_elem *e, void *aux);  // 선언
@@ -55,6 +55,43 @@ byte_cnt (size_t bit_cnt) {
 	return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns an elem_type with bits FROM through TO - 1 turned on,
+   where 0 <= FROM < TO <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t from, size_t to) {
+	elem_type high = to < ELEM_BITS ? ((elem_type) 1 << to) - 1 : (elem_type) -1;
+	return high & ((elem_type) -1 << from);
+}
+
+/* Returns element IDX of B with bits equal to VALUE turned on. */
+static inline elem_type
+elem_match (const struct bitmap *b, size_t idx, bool value) {
+	return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none.  Whole elements
+   without a match are skipped at once. */
+static size_t
+next_match (const struct bitmap *b, size_t start, bool value) {
+	size_t idx, last_idx, bit;
+	elem_type w;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	idx = elem_idx (start);
+	last_idx = elem_cnt (b->bit_cnt) - 1;
+	w = elem_match (b, idx, value) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (w == 0) {
+		if (idx == last_idx)
+			return b->bit_cnt;
+		w = elem_match (b, ++idx, value);
+	}
+	bit = idx * ELEM_BITS + __builtin_ctzl (w);
+	return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -194,33 +231,66 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Elements wholly inside the range are stored at once; the
+   partial elements at either end are updated atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (start < end) {
+		size_t idx = elem_idx (start);
+		size_t from = start % ELEM_BITS;
+		size_t to = end - idx * ELEM_BITS < ELEM_BITS
+			? end - idx * ELEM_BITS : ELEM_BITS;
+		elem_type mask = range_mask (from, to);
+
+		if (mask == (elem_type) -1)
+			b->bits[idx] = value ? (elem_type) -1 : 0;
+		else if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+		start = idx * ELEM_BITS + to;
+	}
+}
+
+/* Returns the number of 1-bits in W.  Done by hand because
+   __builtin_popcountl() becomes a call into libgcc, which the
+   kernel does not link against. */
+static inline unsigned
+popcount (elem_type w) {
+	w = w - ((w >> 1) & 0x5555555555555555UL);
+	w = (w & 0x3333333333333333UL) + ((w >> 2) & 0x3333333333333333UL);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (w * 0x0101010101010101UL) >> 56;
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t value_cnt = 0;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
+	while (start < end) {
+		size_t idx = elem_idx (start);
+		size_t from = start % ELEM_BITS;
+		size_t to = end - idx * ELEM_BITS < ELEM_BITS
+			? end - idx * ELEM_BITS : ELEM_BITS;
+
+		value_cnt += popcount (elem_match (b, idx, value)
+				& range_mask (from, to));
+		start = idx * ELEM_BITS + to;
+	}
 	return value_cnt;
 }
 
@@ -228,16 +298,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && next_match (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -266,7 +331,10 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Hops from the start of each run of VALUE bits to its end, a
+   word at a time, so the cost is linear in the size of the
+   searched range however fragmented it is. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
@@ -274,10 +342,21 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
+		size_t i = start;
+
+		if (cnt == 0)
+			return start <= last ? start : BITMAP_ERROR;
+		while (i <= last) {
+			size_t end;
+
+			i = next_match (b, i, value);
+			if (i > last)
+				break;
+			end = next_match (b, i, !value);
+			if (end - i >= cnt)
 				return i;
+			i = end;
+		}
 	}
 	return BITMAP_ERROR;
 }
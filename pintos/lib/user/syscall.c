@@ -54,7 +54,7 @@ __attribute__((always_inline)) static __inline int64_t syscall(
            ((uint64_t)ARG2), 0, 0, 0))
 
 #define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                     \
-  (syscall(((uint64_t *)NUMBER), ((uint64_t)ARG0), ((uint64_t)ARG1), \
+  (syscall(((uint64_t)NUMBER), ((uint64_t)ARG0), ((uint64_t)ARG1), \
            ((uint64_t)ARG2), ((uint64_t)ARG3), 0, 0))
 
 #define syscall5(NUMBER, ARG0, ARG1, ARG2, ARG3, ARG4)             \
@@ -90,6 +90,8 @@ int open(const char *file) { return syscall1(SYS_OPEN, file); }
 
 int filesize(int fd) { return syscall1(SYS_FILESIZE, fd); }
 
+int fileblocks(int fd) { return syscall1(SYS_FILEBLOCKS, fd); }
+
 int read(int fd, void *buffer, unsigned size) {
   return syscall3(SYS_READ, fd, buffer, size);
 }
@@ -102,6 +104,39 @@ void seek(int fd, unsigned position) { syscall2(SYS_SEEK, fd, position); }
 
 unsigned tell(int fd) { return syscall1(SYS_TELL, fd); }
 
+int pread(int fd, void *buffer, unsigned size, off_t offset) {
+  return syscall4(SYS_PREAD, fd, buffer, size, offset);
+}
+
+int pwrite(int fd, const void *buffer, unsigned size, off_t offset) {
+  return syscall4(SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+  return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+  return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int copy_file_range(int fd_in, off_t off_in, int fd_out, off_t off_out,
+                    unsigned length) {
+  return syscall5(SYS_COPY_FILE_RANGE, fd_in, off_in, fd_out, off_out, length);
+}
+
+int io_setup(struct io_ring *ring, unsigned entries) {
+  return syscall2(SYS_IO_SETUP, ring, entries);
+}
+
+int io_enter(unsigned to_submit, unsigned min_complete) {
+  return syscall2(SYS_IO_ENTER, to_submit, min_complete);
+}
+
+int batch(struct syscall_rec *recs, int cnt, bool stop_on_error) {
+  return syscall3(SYS_BATCH, recs, cnt, stop_on_error);
+}
+
 void close(int fd) { syscall1(SYS_CLOSE, fd); }
 
 int dup2(int oldfd, int newfd) { return syscall2(SYS_DUP2, oldfd, newfd); }
@@ -0,0 +1,46 @@
+/* Grows a file from inline size through a hole and checks that
+   fileblocks() counts only the sectors actually allocated, while
+   filesize() covers the hole, which reads back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HEAD 100                /* Small enough to be stored inline. */
+#define TAIL_OFS (10 * 512)     /* Leaves sectors 1 through 9 a hole. */
+#define TAIL 512
+
+static char expected[TAIL_OFS + TAIL];
+static char actual[TAIL_OFS + TAIL];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (expected, 'h', HEAD);
+  memset (expected + TAIL_OFS, 't', TAIL);
+
+  CHECK (create ("sparse", 0), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  CHECK (write (fd, expected, HEAD) == HEAD, "write %d bytes", HEAD);
+  CHECK (filesize (fd) == HEAD, "filesize is %d", HEAD);
+  CHECK (fileblocks (fd) == 0, "fileblocks is 0 while inline");
+
+  msg ("seek \"sparse\" to %d", TAIL_OFS);
+  seek (fd, TAIL_OFS);
+  CHECK (write (fd, expected + TAIL_OFS, TAIL) == TAIL,
+         "write %d bytes at %d", TAIL, TAIL_OFS);
+  CHECK (filesize (fd) == TAIL_OFS + TAIL, "filesize is %d", TAIL_OFS + TAIL);
+  CHECK (fileblocks (fd) == 2, "fileblocks is 2, for the head and the tail");
+
+  msg ("seek \"sparse\" to 0");
+  seek (fd, 0);
+  CHECK (read (fd, actual, sizeof actual) == (int) sizeof actual,
+         "read \"sparse\"");
+  compare_bytes (actual, expected, sizeof actual, 0, "sparse");
+  CHECK (fileblocks (fd) == 2, "reading the hole allocates nothing");
+  msg ("close \"sparse\"");
+  close (fd);
+}
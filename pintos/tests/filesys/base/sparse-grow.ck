@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-grow) begin
+(sparse-grow) create "sparse"
+(sparse-grow) open "sparse"
+(sparse-grow) write 100 bytes
+(sparse-grow) filesize is 100
+(sparse-grow) fileblocks is 0 while inline
+(sparse-grow) seek "sparse" to 5120
+(sparse-grow) write 512 bytes at 5120
+(sparse-grow) filesize is 5632
+(sparse-grow) fileblocks is 2, for the head and the tail
+(sparse-grow) seek "sparse" to 0
+(sparse-grow) read "sparse"
+(sparse-grow) reading the hole allocates nothing
+(sparse-grow) close "sparse"
+(sparse-grow) end
+EOF
+pass;
@@ -1,3 +1,7 @@
+/* Mounts the second disk at a name, creates a file on it, and
+   checks that the file can be reached through that name only
+   while the disk is mounted. */
+
 #include <syscall.h>
 #include "tests/lib.h"
 #include "tests/main.h"
@@ -5,14 +9,18 @@
 void
 test_main (void) 
 {
-  CHECK (mkdir ("/a"), "mkdir \"/a\"");
-  CHECK (mount ("a", 1, 0) == 0, "mount the second disk at \"/a\"");
-  CHECK (chdir ("a"), "chdir \"/a\"");
-  CHECK (mkdir ("b"), "mkdir \"/a/b\"");
-  CHECK (chdir ("b"), "chdir \"/a/b\"");
-  CHECK (chdir ("/"), "pop back to \"/\"");
-  CHECK (umount ("a") == 0, "unmount the second disk from \"/a\"");
-  CHECK (!chdir ("a/b"), "chdir to unmounted directory (must fail)");
-  CHECK (mount ("a", 1, 0) == 0, "mount the second disk at \"/a\"");
-  CHECK (chdir ("a/b"), "chdir to re-mounted directory");
+  int fd;
+
+  CHECK (mount ("a", 1, 0) == 0, "mount the second disk at \"a\"");
+  CHECK (create ("a/b", 0), "create \"a/b\"");
+  CHECK ((fd = open ("a/b")) > 1, "open \"a/b\"");
+  msg ("close \"a/b\"");
+  close (fd);
+  CHECK (umount ("a") == 0, "unmount the second disk from \"a\"");
+  CHECK (open ("a/b") == -1, "open unmounted \"a/b\" (must fail)");
+  CHECK (mount ("a", 1, 0) == 0, "mount the second disk at \"a\"");
+  CHECK ((fd = open ("a/b")) > 1, "open re-mounted \"a/b\"");
+  msg ("close \"a/b\"");
+  close (fd);
+  CHECK (umount ("a") == 0, "unmount the second disk from \"a\"");
 }
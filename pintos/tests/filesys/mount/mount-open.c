@@ -0,0 +1,32 @@
+/* Mounts the second disk, creates and writes a file on it, and
+   checks that the disk cannot be unmounted while the file is
+   open.  After closing the file and unmounting, mounts the disk
+   again and checks that the file was kept. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "mounted file system";
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mount ("m", 0, 1) == -1, "mount the file system disk (must fail)");
+  CHECK (mount ("m", 1, 0) == 0, "mount hd1:0 at \"m\"");
+  CHECK (create ("m/file", 0), "create \"m/file\"");
+  CHECK ((fd = open ("m/file")) > 1, "open \"m/file\"");
+  CHECK (write (fd, data, sizeof data) == sizeof data, "write \"m/file\"");
+  CHECK (umount ("m") == -1, "unmount \"m\" with \"m/file\" open (must fail)");
+
+  msg ("close \"m/file\"");
+  close (fd);
+  CHECK (umount ("m") == 0, "unmount \"m\"");
+  CHECK (open ("m/file") == -1, "open \"m/file\" while unmounted (must fail)");
+
+  CHECK (mount ("m", 1, 0) == 0, "mount hd1:0 at \"m\" again");
+  check_file ("m/file", data, sizeof data);
+  CHECK (umount ("m") == 0, "unmount \"m\"");
+}
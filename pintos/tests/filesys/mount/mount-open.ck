@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mount-open) begin
+(mount-open) mount the file system disk (must fail)
+(mount-open) mount hd1:0 at "m"
+(mount-open) create "m/file"
+(mount-open) open "m/file"
+(mount-open) write "m/file"
+(mount-open) unmount "m" with "m/file" open (must fail)
+(mount-open) close "m/file"
+(mount-open) unmount "m"
+(mount-open) open "m/file" while unmounted (must fail)
+(mount-open) mount hd1:0 at "m" again
+(mount-open) open "m/file" for verification
+(mount-open) verified contents of "m/file"
+(mount-open) close "m/file"
+(mount-open) unmount "m"
+(mount-open) end
+mount-open: exit(0)
+EOF
+pass;
@@ -0,0 +1,124 @@
+/* Benchmarks bitmap_scan() and bitmap_count() on fragmented
+   bitmaps the size of a disk free map and of a user page pool,
+   and checks their results against a bit-at-a-time reference.
+   Prints timer ticks per batch of scans, which the check
+   ignores; only disagreement with the reference fails. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+/* Scans per timed batch. */
+#define SCANS 200
+
+/* Reference bitmap_scan(): tests every bit of every candidate. */
+static size_t
+naive_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t last, i, j;
+
+  if (cnt > bitmap_size (b))
+    return BITMAP_ERROR;
+  last = bitmap_size (b) - cnt;
+  for (i = start; i <= last; i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Reference bitmap_count(). */
+static size_t
+naive_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      n++;
+  return n;
+}
+
+/* Fills B with runs of random length up to MAX_RUN, set with
+   probability PERCENT / 100, so that free space is scattered in
+   small pieces the way a long-running system leaves it. */
+static void
+fragment (struct bitmap *b, size_t max_run, unsigned percent)
+{
+  size_t i = 0;
+
+  while (i < bitmap_size (b))
+    {
+      size_t run = random_ulong () % max_run + 1;
+      if (run > bitmap_size (b) - i)
+        run = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, run, random_ulong () % 100 < percent);
+      i += run;
+    }
+}
+
+/* Benchmarks one bitmap of BITS bits, looking for free runs of
+   CNT bits. */
+static void
+bench (const char *name, size_t bits, size_t cnt)
+{
+  struct bitmap *b = bitmap_create (bits);
+  size_t starts[SCANS];
+  int64_t t0, fast_ticks, slow_ticks;
+  size_t i;
+
+  if (b == NULL)
+    fail ("bitmap_create (%zu) failed", bits);
+  fragment (b, 16, 70);
+  for (i = 0; i < SCANS; i++)
+    starts[i] = random_ulong () % bits;
+
+  for (i = 0; i < SCANS; i++)
+    {
+      size_t start = starts[i], len = bits - start;
+      if (bitmap_scan (b, start, cnt, false)
+          != naive_scan (b, start, cnt, false))
+        fail ("%s: bitmap_scan (%zu, %zu) disagrees", name, start, cnt);
+      if (bitmap_count (b, start, len, true)
+          != naive_count (b, start, len, true))
+        fail ("%s: bitmap_count (%zu, %zu) disagrees", name, start, len);
+    }
+
+  t0 = timer_ticks ();
+  for (i = 0; i < SCANS; i++)
+    bitmap_scan (b, starts[i], cnt, false);
+  fast_ticks = timer_elapsed (t0);
+
+  t0 = timer_ticks ();
+  for (i = 0; i < SCANS; i++)
+    naive_scan (b, starts[i], cnt, false);
+  slow_ticks = timer_elapsed (t0);
+
+  msg ("%s, %zu bits, runs of %zu: %"PRId64" ticks (bit by bit: %"PRId64")",
+       name, bits, cnt, fast_ticks, slow_ticks);
+  bitmap_destroy (b);
+}
+
+void
+test_bitmap_bench (void)
+{
+  static const size_t cnts[] = {1, 8, 32};
+  size_t i;
+
+  random_init (0);
+  for (i = 0; i < sizeof cnts / sizeof *cnts; i++)
+    {
+      /* 20 MB disk, one bit per sector. */
+      bench ("free map", 40960, cnts[i]);
+      /* 512 MB of user memory, one bit per page. */
+      bench ("user pool", 131072, cnts[i]);
+    }
+  pass ();
+}
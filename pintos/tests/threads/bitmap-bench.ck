@@ -0,0 +1,29 @@
+# -*- perl -*-
+
+# The expected output looks like this, with any tick counts:
+#
+# (bitmap-bench) begin
+# (bitmap-bench) free map, 40960 bits, runs of 1: 3 ticks (bit by bit: 21)
+# (bitmap-bench) user pool, 131072 bits, runs of 1: 9 ticks (bit by bit: 70)
+# ...
+# (bitmap-bench) PASS
+# (bitmap-bench) end
+#
+# The tick counts are only informational.  The test fails if the
+# word-at-a-time scans disagree with the bit-at-a-time reference.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@timings) = grep (/bits, runs of \d+: \d+ ticks/, @output);
+fail "6 timings expected but " . scalar (@timings) . " found\n"
+  if @timings != 6;
+fail "No PASS message found\n" if !grep (/\(bitmap-bench\) PASS/, @output);
+
+pass;
@@ -0,0 +1,50 @@
+/* Runs batches of system calls with batch(), checking that one
+   with stop_on_error stops after the first failing call, that
+   one without it runs every call, and that an unknown system
+   call number fails instead of killing the process. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Fills in R as a call to NR with arguments A0 and A1. */
+static void
+rec (struct syscall_rec *r, uint64_t nr, uint64_t a0, uint64_t a1)
+{
+  r->nr = nr;
+  r->args[0] = a0;
+  r->args[1] = a1;
+  r->ret = 77;
+}
+
+void
+test_main (void) 
+{
+  struct syscall_rec recs[3];
+  int fd;
+
+  rec (&recs[0], SYS_CREATE, (uint64_t) "a", 0);
+  rec (&recs[1], SYS_OPEN, (uint64_t) "missing", 0);
+  rec (&recs[2], SYS_CREATE, (uint64_t) "b", 0);
+  CHECK (batch (recs, 3, true) == 2, "batch with stop_on_error runs 2 calls");
+  CHECK (recs[0].ret == 1, "create \"a\" succeeded");
+  CHECK (recs[1].ret == -1, "open \"missing\" failed");
+  CHECK (recs[2].ret == 77, "create \"b\" was not run");
+  CHECK (open ("b") == -1, "open \"b\" (must fail)");
+
+  rec (&recs[0], SYS_OPEN, (uint64_t) "missing", 0);
+  rec (&recs[1], 9999, 0, 0);
+  rec (&recs[2], SYS_CREATE, (uint64_t) "c", 0);
+  CHECK (batch (recs, 3, false) == 3,
+         "batch without stop_on_error runs 3 calls");
+  CHECK (recs[0].ret == -1, "open \"missing\" failed");
+  CHECK (recs[1].ret == -1, "unknown system call failed");
+  CHECK (recs[2].ret == 1, "create \"c\" succeeded");
+  CHECK ((fd = open ("c")) > 1, "open \"c\"");
+  msg ("close \"c\"");
+  close (fd);
+
+  CHECK (batch (recs, 0, false) == -1, "empty batch (must fail)");
+}
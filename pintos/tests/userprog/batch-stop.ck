@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(batch-stop) begin
+(batch-stop) batch with stop_on_error runs 2 calls
+(batch-stop) create "a" succeeded
+(batch-stop) open "missing" failed
+(batch-stop) create "b" was not run
+(batch-stop) open "b" (must fail)
+(batch-stop) batch without stop_on_error runs 3 calls
+(batch-stop) open "missing" failed
+(batch-stop) unknown system call failed
+(batch-stop) create "c" succeeded
+(batch-stop) open "c"
+(batch-stop) close "c"
+(batch-stop) empty batch (must fail)
+(batch-stop) end
+batch-stop: exit(0)
+EOF
+pass;
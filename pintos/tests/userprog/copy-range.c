@@ -0,0 +1,52 @@
+/* Copies between two files with copy_file_range(), at explicit
+   offsets and at the file positions, and checks that copies
+   stop at end of file and that overlapping or overflowing
+   ranges are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "Now is the time for all good men to come to "
+                           "the aid of the party.";
+
+void
+test_main (void) 
+{
+  const int len = sizeof data - 1;
+  char expected[sizeof data + 4];
+  int src, dst;
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src, data, len) == len, "write \"src\"");
+
+  CHECK (copy_file_range (src, 0, dst, 0, len) == len,
+         "copy all of \"src\" to \"dst\"");
+  CHECK (tell (dst) == 0, "\"dst\" position is still 0");
+  CHECK (copy_file_range (src, len - 4, dst, len, 100) == 4,
+         "copy past end of \"src\" (gets 4 bytes)");
+
+  msg ("seek \"src\" and \"dst\" to 0");
+  seek (src, 0);
+  seek (dst, 0);
+  CHECK (copy_file_range (src, -1, dst, -1, 4) == 4,
+         "copy 4 bytes at the file positions");
+  CHECK (tell (src) == 4 && tell (dst) == 4, "both positions moved to 4");
+
+  CHECK (copy_file_range (src, 0, src, 4, 8) == -1,
+         "copy overlapping range of \"src\" (must fail)");
+  CHECK (copy_file_range (src, 0, dst, 0x7ffffff0, 100) == -1,
+         "copy past largest file offset (must fail)");
+
+  msg ("close \"src\" and \"dst\"");
+  close (src);
+  close (dst);
+
+  memcpy (expected, data, len);
+  memcpy (expected + len, data + len - 4, 4);
+  check_file ("dst", expected, len + 4);
+}
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) create "dst"
+(copy-range) open "src"
+(copy-range) open "dst"
+(copy-range) write "src"
+(copy-range) copy all of "src" to "dst"
+(copy-range) "dst" position is still 0
+(copy-range) copy past end of "src" (gets 4 bytes)
+(copy-range) seek "src" and "dst" to 0
+(copy-range) copy 4 bytes at the file positions
+(copy-range) both positions moved to 4
+(copy-range) copy overlapping range of "src" (must fail)
+(copy-range) copy past largest file offset (must fail)
+(copy-range) close "src" and "dst"
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Writes a file with pwrite() and reads it back with pread() at
+   several offsets, checking that neither call moves the file
+   position. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "0123456789abcdef";
+
+void
+test_main (void) 
+{
+  char buf[sizeof data];
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (pwrite (fd, data + 8, 8, 8) == 8, "pwrite 8 bytes at offset 8");
+  CHECK (pwrite (fd, data, 8, 0) == 8, "pwrite 8 bytes at offset 0");
+  CHECK (tell (fd) == 0, "file position is still 0");
+  CHECK (filesize (fd) == 16, "file size is 16");
+
+  CHECK (pread (fd, buf, 4, 6) == 4, "pread 4 bytes at offset 6");
+  compare_bytes (buf, data + 6, 4, 6, "data");
+  CHECK (pread (fd, buf, 8, 12) == 4, "pread 8 bytes at offset 12 (gets 4)");
+  compare_bytes (buf, data + 12, 4, 12, "data");
+  CHECK (pread (fd, buf, 4, 16) == 0, "pread at end of file");
+  CHECK (tell (fd) == 0, "file position is still 0");
+
+  CHECK (pread (fd, buf, 4, -1) == -1, "pread at offset -1 (must fail)");
+  CHECK (pwrite (fd, data, 4, -1) == -1, "pwrite at offset -1 (must fail)");
+  msg ("close \"data\"");
+  close (fd);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) pwrite 8 bytes at offset 8
+(pread-pwrite) pwrite 8 bytes at offset 0
+(pread-pwrite) file position is still 0
+(pread-pwrite) file size is 16
+(pread-pwrite) pread 4 bytes at offset 6
+(pread-pwrite) pread 8 bytes at offset 12 (gets 4)
+(pread-pwrite) pread at end of file
+(pread-pwrite) file position is still 0
+(pread-pwrite) pread at offset -1 (must fail)
+(pread-pwrite) pwrite at offset -1 (must fail)
+(pread-pwrite) close "data"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Writes a file from three buffers with writev() and reads it
+   back into buffers of other sizes with readv(), including a
+   read that stops short at end of file. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "The quick brown fox jumps over the lazy dog";
+
+void
+test_main (void) 
+{
+  char a[10], b[20], c[40];
+  struct iovec out[3] = {
+    { (void *) data, 4 },
+    { (void *) (data + 4), 16 },
+    { (void *) (data + 20), sizeof data - 21 },
+  };
+  struct iovec in[3] = { { a, sizeof a }, { b, sizeof b }, { c, sizeof c } };
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (writev (fd, out, 3) == sizeof data - 1, "writev 3 buffers");
+  CHECK (tell (fd) == sizeof data - 1, "file position is at end of file");
+
+  msg ("seek \"data\" to 0");
+  seek (fd, 0);
+  CHECK (readv (fd, in, 3) == sizeof data - 1,
+         "readv into 3 buffers (stops at end of file)");
+  compare_bytes (a, data, sizeof a, 0, "data");
+  compare_bytes (b, data + sizeof a, sizeof b, sizeof a, "data");
+  compare_bytes (c, data + sizeof a + sizeof b,
+                 sizeof data - 1 - sizeof a - sizeof b,
+                 sizeof a + sizeof b, "data");
+
+  CHECK (readv (fd, in, 0) == -1, "readv of 0 buffers (must fail)");
+  msg ("close \"data\"");
+  close (fd);
+}
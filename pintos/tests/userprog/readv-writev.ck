@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev 3 buffers
+(readv-writev) file position is at end of file
+(readv-writev) seek "data" to 0
+(readv-writev) readv into 3 buffers (stops at end of file)
+(readv-writev) readv of 0 buffers (must fail)
+(readv-writev) close "data"
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,104 @@
+/* Reads and writes a file through the asynchronous I/O ring: a
+   write, an fsync, and two reads in flight at once.  Then reads
+   into a file mapping and unmaps it before reaping the read,
+   which must wait for the read instead of freeing the page it
+   is writing to. */
+
+#include <io-ring.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Spans three pages. */
+#define SIZE (2 * 4096 + 100)
+
+static struct io_ring *ring = (struct io_ring *) 0x10000000;
+static char buf[SIZE];
+static char rbuf[SIZE];
+
+/* Queues a request. */
+static void
+submit (uint8_t op, int fd, void *p, uint32_t len, int32_t off,
+        uint64_t user_data)
+{
+  struct io_sqe *sqe = &ring->sq[ring->sq_tail & (ring->entries - 1)];
+
+  memset (sqe, 0, sizeof *sqe);
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = p;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = user_data;
+  __atomic_store_n (&ring->sq_tail, ring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Takes the next completion, which must be there. */
+static struct io_cqe
+next_completion (void)
+{
+  struct io_cqe cqe;
+
+  if (ring->cq_head == __atomic_load_n (&ring->cq_tail, __ATOMIC_ACQUIRE))
+    fail ("completion queue is empty");
+  cqe = ring->cq[ring->cq_head & (ring->entries - 1)];
+  __atomic_store_n (&ring->cq_head, ring->cq_head + 1, __ATOMIC_RELEASE);
+  return cqe;
+}
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x20000000;
+  struct io_cqe c1, c2, tmp;
+  int fd, map_fd;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  CHECK (io_setup (ring, 8) == 0, "io_setup");
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  submit (IO_PWRITE, fd, buf, SIZE, 0, 1);
+  CHECK (io_enter (1, 1) == 1, "submit a write and wait for it");
+  c1 = next_completion ();
+  CHECK (c1.user_data == 1 && c1.res == SIZE, "write completed");
+
+  submit (IO_FSYNC, fd, NULL, 0, 0, 2);
+  CHECK (io_enter (1, 1) == 1, "submit an fsync and wait for it");
+  c1 = next_completion ();
+  CHECK (c1.user_data == 2 && c1.res == 0, "fsync completed");
+
+  submit (IO_PREAD, fd, rbuf, 4096, 0, 3);
+  submit (IO_PREAD, fd, rbuf + 4096, SIZE - 4096, 4096, 4);
+  CHECK (io_enter (2, 2) == 2, "submit two reads and wait for both");
+  c1 = next_completion ();
+  c2 = next_completion ();
+  if (c1.user_data == 4)
+    {
+      tmp = c1;
+      c1 = c2;
+      c2 = tmp;
+    }
+  CHECK (c1.user_data == 3 && c1.res == 4096
+         && c2.user_data == 4 && c2.res == SIZE - 4096,
+         "both reads completed");
+  compare_bytes (rbuf, buf, SIZE, 0, "data");
+
+  CHECK ((map_fd = open ("data")) > 1, "open \"data\" again");
+  CHECK (mmap (map, 4096, 1, map_fd, 0) != MAP_FAILED, "mmap \"data\"");
+  submit (IO_PREAD, fd, map + 100, 1000, 0, 5);
+  CHECK (io_enter (1, 0) == 1, "submit a read into the mapping");
+  msg ("munmap \"data\"");
+  munmap (map);
+  c1 = next_completion ();
+  CHECK (c1.user_data == 5 && c1.res == 1000,
+         "read into the mapping completed");
+
+  msg ("close \"data\"");
+  close (map_fd);
+  close (fd);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-rw) begin
+(aio-rw) io_setup
+(aio-rw) create "data"
+(aio-rw) open "data"
+(aio-rw) submit a write and wait for it
+(aio-rw) write completed
+(aio-rw) submit an fsync and wait for it
+(aio-rw) fsync completed
+(aio-rw) submit two reads and wait for both
+(aio-rw) both reads completed
+(aio-rw) open "data" again
+(aio-rw) mmap "data"
+(aio-rw) submit a read into the mapping
+(aio-rw) munmap "data"
+(aio-rw) read into the mapping completed
+(aio-rw) close "data"
+(aio-rw) end
+EOF
+pass;
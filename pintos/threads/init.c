@@ -215,6 +215,10 @@ parse_options(char** argv) {
 #ifdef FILESYS
 		else if (!strcmp(name, "-f"))
       format_filesys = true;
+    else if (!strcmp(name, "-iosched")) {
+      if (!disk_set_scheduler(value))
+        PANIC("unknown I/O scheduler `%s' (use -h for help)", value);
+    }
 #endif
     else if (!strcmp(name, "-rs"))
       random_init(atoi(value));
@@ -225,6 +229,16 @@ parse_options(char** argv) {
       user_page_limit = atoi(value);
     else if (!strcmp(name, "-threads-tests"))
       thread_tests = true;
+#endif
+#ifdef VM
+    else if (!strcmp(name, "-swap")) {
+      if (!swap_parse_option(value))
+        PANIC("bad swap disk `%s' (use -h for help)", value);
+    }
+    else if (!strcmp(name, "-swapfile")) {
+      if (!swap_parse_file_option(value))
+        PANIC("bad swap file `%s' (use -h for help)", value);
+    }
 #endif
     else
       PANIC("unknown option `%s' (use -h for help)", name);
@@ -321,10 +335,18 @@ usage(void) {
       "  -h                 Print this help message and power off.\n"
       "  -q                 Power off VM after actions or on panic.\n"
       "  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+      "  -iosched=NAME      Use disk I/O scheduler NAME: deadline or noop.\n"
+#endif
       "  -rs=SEED           Set random number seed to SEED.\n"
       "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
       "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+      "  -swap=1:1[:PRIO]   Swap to disk hd1:1 with priority PRIO.\n"
+      "  -swapfile=NAME[:PAGES[:PRIO]]  Also swap to file NAME, (re)created\n"
+      "                     with PAGES pages if given, at priority PRIO.\n"
 #endif
       );
   power_off();
@@ -358,4 +380,7 @@ print_stats(void) {
 #ifdef USERPROG
   exception_print_stats();
 #endif
+#ifdef VM
+  swap_print_stats();
+#endif
 }
\ No newline at end of file
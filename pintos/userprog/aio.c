@@ -0,0 +1,370 @@
+#include "userprog/aio.h"
+
+#include <io-ring.h>
+#include <limits.h>
+#include <list.h>
+#include <string.h>
+
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/vm.h"
+
+/* 요청을 처리하는 커널 워커 스레드 수. IDE 채널 수만큼 둔다. */
+#define AIO_WORKERS 2
+
+/* 프로세스마다 하나씩 있는 링 상태. */
+struct aio_ctx {
+  struct io_ring* ring;  // 링 페이지의 커널 주소 (프레임이 고정되어 있다)
+  void* uaddr;           // 링 페이지의 유저 주소
+  uint32_t mask;         // entries - 1
+  struct thread* owner;  // 링을 만든 프로세스
+  struct lock lock;      // cq_tail, inflight, done 보호
+  struct condition cond; // 완료될 때마다 broadcast
+  unsigned inflight;     // 제출했지만 아직 완료되지 않은 요청 수
+  struct list done;      // 완료됐지만 아직 정리(reap)하지 않은 요청
+};
+
+/* 워커에게 넘기는 요청 하나. */
+struct aio_req {
+  struct list_elem elem;  // 작업 큐 또는 ctx->done
+  struct aio_ctx* ctx;
+  struct io_sqe sqe;      // 제출 시점에 복사한 SQE
+  struct file* file;      // file_add_ref()로 잡아 둔 파일, 없으면 NULL
+  bool pinned;            // sqe.buf를 vm_pin_buffer()로 고정했는가
+};
+
+/* 모든 프로세스가 공유하는 작업 큐. */
+static struct list queue;
+static struct lock queue_lock;
+static struct condition queue_cond;
+static bool workers_started;
+
+static void worker(void* aux);
+static void complete(struct aio_req* r, int res);
+static void reap(struct aio_ctx* ctx);
+
+/* 처음 링이 만들어질 때 작업 큐와 워커 스레드를 준비한다. */
+static void start_workers(void) {
+  list_init(&queue);
+  lock_init(&queue_lock);
+  cond_init(&queue_cond);
+  for (int i = 0; i < AIO_WORKERS; i++)
+    thread_create("aio", PRI_DEFAULT, worker, NULL);
+  workers_started = true;
+}
+
+/*
+ * aio_setup()
+ * - 유저 주소 addr에 링 페이지를 새로 만들어 매핑하고, entries 크기의
+ *   큐로 초기화한다. 페이지는 링이 없어질 때까지 고정된다.
+ * - entries는 IO_RING_MAX 이하의 2의 거듭제곱이어야 하고,
+ *   addr은 비어 있는 페이지 정렬 주소여야 한다.
+ * - 프로세스당 링은 하나. 성공하면 0, 실패하면 -1.
+ */
+int aio_setup(void* addr, unsigned entries) {
+  struct thread* curr = thread_current();
+
+  if (curr->aio != NULL) return -1;
+  if (entries == 0 || entries > IO_RING_MAX || (entries & (entries - 1)))
+    return -1;
+  if (addr == NULL || pg_ofs(addr) != 0 || !is_user_vaddr(addr)) return -1;
+  if (spt_find_page(&curr->spt, addr) != NULL) return -1;
+
+  struct aio_ctx* ctx = malloc(sizeof *ctx);
+  if (ctx == NULL) return -1;
+  if (!vm_alloc_page(VM_ANON, addr, true)) {
+    free(ctx);
+    return -1;
+  }
+  if (!vm_pin_buffer(addr, PGSIZE, true)) {
+    spt_remove_page(&curr->spt, spt_find_page(&curr->spt, addr));
+    free(ctx);
+    return -1;
+  }
+
+  if (!workers_started) start_workers();
+
+  ctx->ring = pml4_get_page(curr->pml4, addr);
+  ctx->uaddr = addr;
+  ctx->mask = entries - 1;
+  ctx->owner = curr;
+  lock_init(&ctx->lock);
+  cond_init(&ctx->cond);
+  ctx->inflight = 0;
+  list_init(&ctx->done);
+
+  memset(ctx->ring, 0, PGSIZE);
+  ctx->ring->entries = entries;
+  curr->aio = ctx;
+  return 0;
+}
+
+/*
+ * prepare()
+ * - 미리 할당한 r에 SQE 하나를 검사해 담고 파일 참조와 버퍼 고정을 잡는다.
+ * - NOP이나 잘못된 요청은 워커를 거치지 않고 바로 완료시키고 NULL을 반환한다.
+ */
+static struct aio_req* prepare(struct aio_ctx* ctx, struct aio_req* r,
+                               const struct io_sqe* sqe) {
+  struct thread* curr = thread_current();
+
+  r->ctx = ctx;
+  r->sqe = *sqe;
+  r->file = NULL;
+  r->pinned = false;
+
+  lock_acquire(&ctx->lock);
+  ctx->inflight++;
+  lock_release(&ctx->lock);
+
+  if (sqe->op == IO_NOP) {
+    complete(r, 0);
+    return NULL;
+  }
+
+  struct file* file = NULL;
+  if (sqe->op <= IO_FSYNC && sqe->fd >= 2 && sqe->fd < FDT_SIZE)
+    file = curr->fdt[sqe->fd];
+  if (file == NULL || file == STDIN_MARKER || file == STDOUT_MARKER) {
+    complete(r, -1);
+    return NULL;
+  }
+
+  if (sqe->op != IO_FSYNC) {
+    bool is_read = sqe->op == IO_READ || sqe->op == IO_PREAD;
+    bool positioned = sqe->op == IO_PREAD || sqe->op == IO_PWRITE;
+
+    if (sqe->len > IO_LEN_MAX || (positioned && sqe->off < 0) ||
+        !vm_pin_buffer(sqe->buf, sqe->len, is_read)) {
+      complete(r, -1);
+      return NULL;
+    }
+    r->pinned = true;
+  }
+
+  file_add_ref(file);
+  r->file = file;
+  return r;
+}
+
+/*
+ * aio_enter()
+ * - 제출 큐에서 최대 to_submit개의 요청을 꺼내 워커에게 넘긴다.
+ *   완료 큐가 넘치지 않도록, 진행 중인 요청과 읽지 않은 완료의 합이
+ *   entries를 넘으면 거기서 멈춘다. 요청을 할당하지 못해도 그 SQE를
+ *   큐에 남겨 둔 채 멈춘다.
+ * - 그 뒤 완료 큐에 min_complete개 이상이 쌓이거나 진행 중인 요청이
+ *   없어질 때까지 기다린다.
+ * - 제출한 요청 수를 반환한다. 링이 없으면 -1.
+ */
+int aio_enter(unsigned to_submit, unsigned min_complete) {
+  struct aio_ctx* ctx = thread_current()->aio;
+  if (ctx == NULL) return -1;
+
+  struct io_ring* ring = ctx->ring;
+  unsigned entries = ctx->mask + 1;
+  unsigned submitted = 0;
+
+  reap(ctx);
+  while (submitted < to_submit) {
+    uint32_t head = ring->sq_head;
+    uint32_t tail = __atomic_load_n(&ring->sq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) break;
+
+    lock_acquire(&ctx->lock);
+    bool room = ctx->inflight + (ring->cq_tail - ring->cq_head) < entries;
+    lock_release(&ctx->lock);
+    if (!room) break;
+
+    // SQE를 소비하기 전에 할당해야 실패해도 CQE 없이 사라지는 요청이 없다
+    struct aio_req* r = malloc(sizeof *r);
+    if (r == NULL) break;
+
+    struct io_sqe sqe = ring->sq[head & ctx->mask];
+    __atomic_store_n(&ring->sq_head, head + 1, __ATOMIC_RELEASE);
+    submitted++;
+
+    r = prepare(ctx, r, &sqe);
+    if (r != NULL) {
+      lock_acquire(&queue_lock);
+      list_push_back(&queue, &r->elem);
+      cond_signal(&queue_cond, &queue_lock);
+      lock_release(&queue_lock);
+    }
+  }
+
+  lock_acquire(&ctx->lock);
+  while (ctx->inflight > 0 &&
+         __atomic_load_n(&ring->cq_tail, __ATOMIC_RELAXED) -
+                 __atomic_load_n(&ring->cq_head, __ATOMIC_ACQUIRE) <
+             min_complete)
+    cond_wait(&ctx->cond, &ctx->lock);
+  lock_release(&ctx->lock);
+
+  reap(ctx);
+  return submitted;
+}
+
+/*
+ * aio_drain()
+ * - 현재 프로세스의 진행 중인 요청이 모두 끝날 때까지 기다린 뒤 정리해서
+ *   요청들이 잡고 있던 버퍼 고정을 푼다.
+ * - 고정된 페이지를 없애기 전에 (munmap 등) 부른다. 링이 없으면 아무 일도 않는다.
+ */
+void aio_drain(void) {
+  struct aio_ctx* ctx = thread_current()->aio;
+  if (ctx == NULL) return;
+
+  lock_acquire(&ctx->lock);
+  while (ctx->inflight > 0) cond_wait(&ctx->cond, &ctx->lock);
+  lock_release(&ctx->lock);
+
+  reap(ctx);
+}
+
+/*
+ * aio_destroy()
+ * - 현재 프로세스의 링을 없앤다. 진행 중인 요청이 모두 끝날 때까지 기다린 뒤
+ *   요청들을 정리하고 링 페이지의 고정을 푼다.
+ * - 주소 공간이나 fd 테이블을 정리하기 전에 불러야 한다.
+ */
+void aio_destroy(void) {
+  struct thread* curr = thread_current();
+  struct aio_ctx* ctx = curr->aio;
+  if (ctx == NULL) return;
+
+  aio_drain();
+  vm_unpin_buffer(ctx->uaddr, PGSIZE);
+  curr->aio = NULL;
+  free(ctx);
+}
+
+/* 워커가 요청의 버퍼를 페이지 단위로 옮긴다.
+ * 버퍼는 고정되어 있으므로 소유 프로세스의 pml4에서 커널 주소를 얻어 쓴다.
+ * filesys_lock은 user_io()처럼 한 페이지를 옮기는 동안만 잡아서, 긴 요청이
+ * 다른 워커나 동기 시스템 콜을 오래 막지 않게 한다.
+ * READ/WRITE는 먼저 lock 안에서 파일 위치를 읽고 옮길 길이만큼 한 번에
+ * 옮겨 둔 뒤, 그 범위를 위치 지정 I/O로 옮긴다. 그래야 페이지 사이에 다른
+ * 요청이 끼어들어도 요청마다 연속된 범위를 읽고 쓴다.
+ * 페이지가 매핑되어 있지 않으면 (고정이 깨졌다면) 거기서 -1로 끝낸다. */
+static int transfer(struct aio_req* r) {
+  const struct io_sqe* sqe = &r->sqe;
+  bool is_read = sqe->op == IO_READ || sqe->op == IO_PREAD;
+  bool positioned = sqe->op == IO_PREAD || sqe->op == IO_PWRITE;
+  uint64_t* pml4 = r->ctx->owner->pml4;
+  off_t base = sqe->off;
+  size_t len = sqe->len;
+  size_t done = 0;
+  bool fault = false;
+
+  if (!positioned) {
+    lock_acquire(&filesys_lock);
+    base = file_tell(r->file);
+    if (is_read) {
+      // EOF 너머까지 위치를 옮기지 않도록 읽을 수 있는 만큼만 잡는다
+      off_t left = file_length(r->file) - base;
+      if (left < 0) left = 0;
+      if ((size_t)left < len) len = left;
+    }
+    if ((off_t)len > INT_MAX - base) {
+      lock_release(&filesys_lock);
+      return -1;
+    }
+    file_seek(r->file, base + len);
+    lock_release(&filesys_lock);
+  }
+
+  while (done < len) {
+    uint8_t* u = (uint8_t*)sqe->buf + done;
+    size_t seg = PGSIZE - pg_ofs(u);
+    if (seg > len - done) seg = len - done;
+
+    void* kva = pml4_get_page(pml4, u);
+    if (kva == NULL) {
+      fault = true;
+      break;
+    }
+
+    lock_acquire(&filesys_lock);
+    off_t n = is_read ? file_read_at(r->file, kva, seg, base + done)
+                      : file_write_at(r->file, kva, seg, base + done);
+    lock_release(&filesys_lock);
+
+    // 커널 주소로 썼으니 유저 PTE의 dirty 비트를 대신 세운다 (mmap 페이지용)
+    if (is_read && n > 0) pml4_set_dirty(pml4, u, true);
+
+    done += n;
+    if ((size_t)n != seg) break;
+  }
+
+  // 덜 옮겼으면 그 뒤로 아무도 위치를 바꾸지 않은 경우에만 되돌린다
+  if (!positioned && done < len) {
+    lock_acquire(&filesys_lock);
+    if (file_tell(r->file) == base + (off_t)len) file_seek(r->file, base + done);
+    lock_release(&filesys_lock);
+  }
+  return fault ? -1 : (int)done;
+}
+
+/* 작업 큐에서 요청을 꺼내 실행하는 워커 스레드. */
+static void worker(void* aux UNUSED) {
+  for (;;) {
+    lock_acquire(&queue_lock);
+    while (list_empty(&queue)) cond_wait(&queue_cond, &queue_lock);
+    struct aio_req* r = list_entry(list_pop_front(&queue), struct aio_req, elem);
+    lock_release(&queue_lock);
+
+    int res = 0;
+    if (r->sqe.op == IO_FSYNC) {
+      lock_acquire(&filesys_lock);
+      file_sync(r->file);
+      lock_release(&filesys_lock);
+    } else {
+      res = transfer(r);
+    }
+
+    complete(r, res);
+  }
+}
+
+/* R의 결과를 완료 큐에 올리고 기다리는 프로세스를 깨운다.
+ * 정리는 소유 프로세스가 reap()에서 한다. */
+static void complete(struct aio_req* r, int res) {
+  struct aio_ctx* ctx = r->ctx;
+  struct io_ring* ring = ctx->ring;
+
+  lock_acquire(&ctx->lock);
+  uint32_t tail = ring->cq_tail;
+  struct io_cqe* cqe = &ring->cq[tail & ctx->mask];
+  cqe->user_data = r->sqe.user_data;
+  cqe->res = res;
+  __atomic_store_n(&ring->cq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  ctx->inflight--;
+  list_push_back(&ctx->done, &r->elem);
+  cond_broadcast(&ctx->cond, &ctx->lock);
+  lock_release(&ctx->lock);
+}
+
+/* 완료된 요청들의 버퍼 고정과 파일 참조를 풀고 해제한다.
+ * 고정은 소유 프로세스의 SPT 기준이라 반드시 소유 프로세스가 부른다. */
+static void reap(struct aio_ctx* ctx) {
+  struct list done;
+
+  list_init(&done);
+  lock_acquire(&ctx->lock);
+  while (!list_empty(&ctx->done)) list_push_back(&done, list_pop_front(&ctx->done));
+  lock_release(&ctx->lock);
+
+  while (!list_empty(&done)) {
+    struct aio_req* r = list_entry(list_pop_front(&done), struct aio_req, elem);
+    if (r->pinned) vm_unpin_buffer(r->sqe.buf, r->sqe.len);
+    if (r->file != NULL && file_should_close(r->file)) file_close(r->file);
+    free(r);
+  }
+}
@@ -7,6 +7,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "userprog/gdt.h"
+#include "userprog/uaccess.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -138,6 +139,11 @@ static void page_fault(struct intr_frame *f) {
   /* For project 3 and later. */
   if (vm_try_handle_fault(f, fault_addr, user, write, not_present)) return;
 #endif
+#ifdef USERPROG
+  /* A bad user address passed to copy_from_user() and friends:
+     resume at the fixup, which reports the failure. */
+  if (!user && exception_fixup(f)) return;
+#endif
 /* 최종 코드
   결국 페이지 폴트가 발생하는 경우에 exit(-1)을 호출하면 되는거라 일단 원본
   유지하고 USERPROG일 때만 호출 될 수 있도록 했습니다!!
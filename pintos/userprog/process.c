@@ -18,6 +18,7 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/aio.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -458,6 +459,13 @@ int process_wait(tid_t child_tid) {
 void process_exit(void) {
   struct thread* curr = thread_current();
 #ifdef USERPROG
+  // 진행 중인 비동기 I/O가 파일과 유저 페이지를 쓰고 있으니 먼저 끝낸다
+  aio_destroy();
+
+  // batch() 도중에 exit()했다면 그 버퍼를 해제한다
+  free(curr->batch);
+  curr->batch = NULL;
+
   // fdt 할당 해제
   if (curr->fdt != NULL) {
     for (int i = 0; i < FDT_SIZE; i++) {
@@ -502,6 +510,8 @@ void process_exit(void) {
 static void process_cleanup(void) {
   struct thread* curr = thread_current();
 
+  aio_destroy();  // exec로 주소 공간을 버리기 전에 링도 없앤다
+
 #ifdef VM
   supplemental_page_table_kill(&curr->spt);
 #endif
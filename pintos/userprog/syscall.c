@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 
@@ -14,15 +15,23 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/aio.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
 #include "vm/vm.h"
 
 #define FDT_SIZE 512
+/* user_io()가 한 번에 고정하는 최대 바이트 수.
+ * 큰 요청이 사용자 풀을 통째로 고정해 축출을 막지 않도록 나눠서 처리한다. */
+#define PIN_CHUNK (64 * PGSIZE)
+/* copy_file_range()가 한 번에 읽고 쓰는 크기 */
+#define COPY_BATCH (8 * PGSIZE)
 typedef int pid_t;
 
 void syscall_entry(void);
@@ -34,12 +43,25 @@ bool create(const char* file, unsigned initial_size);
 bool remove(const char* file);
 int open(const char* file);
 int filesize(int fd);
+int fileblocks(int fd);
 int read(int fd, void* buffer, unsigned size);
 int write(int fd, const void* buffer, unsigned size);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
 void close(int fd);
-bool copy_in(void* dst, const void* usrc, size_t size);
+int pread(int fd, void* buffer, unsigned size, off_t offset);
+int pwrite(int fd, const void* buffer, unsigned size, off_t offset);
+int readv(int fd, const struct iovec* iov, int iovcnt);
+int writev(int fd, const struct iovec* iov, int iovcnt);
+int copy_file_range(int fd_in, off_t off_in, int fd_out, off_t off_out,
+                    unsigned length);
+int batch(struct intr_frame* f, struct syscall_rec* recs, int cnt,
+          bool stop_on_error);
+static int user_io(struct file* file, void* buffer, size_t size, off_t ofs,
+                   bool is_read);
+static struct iovec* copy_in_iovec(const struct iovec* uiov, int iovcnt,
+                                   bool writable);
+static void unpin_iovec(struct iovec* kiov, int iovcnt);
 bool copy_in_string(char* dst, const char* us, size_t dst_sz, size_t* out_len);
 struct lock filesys_lock;
 int exec(const char* cmd_line);
@@ -48,7 +70,8 @@ int wait(pid_t pid);
 int dup2(int oldfd, int newfd);
 void* mmap(void* addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void* addr);
-void* check_and_get_page(const void* uaddr);
+int mount(const char* path, int chan_no, int dev_no);
+int umount(const char* path);
 
 #define MSR_STAR 0xc0000081         /* Segment selector msr */
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target */
@@ -105,11 +128,53 @@ void syscall_handler(struct intr_frame* f UNUSED) {
       f->R.rax = filesize((int)f->R.rdi);
       break;
     }
+    case SYS_FILEBLOCKS: {
+      f->R.rax = fileblocks((int)f->R.rdi);
+      break;
+    }
     case SYS_TELL: {
       int fd = (int)f->R.rdi;
       f->R.rax = tell(fd);
       break;
     }
+    case SYS_PREAD: {
+      f->R.rax = pread((int)f->R.rdi, (void*)f->R.rsi, (unsigned)f->R.rdx,
+                       (off_t)f->R.r10);
+      break;
+    }
+    case SYS_PWRITE: {
+      f->R.rax = pwrite((int)f->R.rdi, (const void*)f->R.rsi,
+                        (unsigned)f->R.rdx, (off_t)f->R.r10);
+      break;
+    }
+    case SYS_READV: {
+      f->R.rax =
+          readv((int)f->R.rdi, (const struct iovec*)f->R.rsi, (int)f->R.rdx);
+      break;
+    }
+    case SYS_WRITEV: {
+      f->R.rax =
+          writev((int)f->R.rdi, (const struct iovec*)f->R.rsi, (int)f->R.rdx);
+      break;
+    }
+    case SYS_IO_SETUP: {
+      f->R.rax = aio_setup((void*)f->R.rdi, (unsigned)f->R.rsi);
+      break;
+    }
+    case SYS_IO_ENTER: {
+      f->R.rax = aio_enter((unsigned)f->R.rdi, (unsigned)f->R.rsi);
+      break;
+    }
+    case SYS_BATCH: {
+      f->R.rax = batch(f, (struct syscall_rec*)f->R.rdi, (int)f->R.rsi,
+                       (bool)f->R.rdx);
+      break;
+    }
+    case SYS_COPY_FILE_RANGE: {
+      f->R.rax = copy_file_range((int)f->R.rdi, (off_t)f->R.rsi, (int)f->R.rdx,
+                                 (off_t)f->R.r10, (unsigned)f->R.r8);
+      break;
+    }
     case SYS_EXEC: {
       exec((const char*)f->R.rdi);
       break;
@@ -174,6 +239,14 @@ void syscall_handler(struct intr_frame* f UNUSED) {
       do_munmap((void*)f->R.rdi);
       break;
     }
+    case SYS_MOUNT: {
+      f->R.rax = mount((const char*)f->R.rdi, (int)f->R.rsi, (int)f->R.rdx);
+      break;
+    }
+    case SYS_UMOUNT: {
+      f->R.rax = umount((const char*)f->R.rdi);
+      break;
+    }
     default: {
       printf("system call 오류 : 알 수 없는 시스템콜 번호 %d\n",
              syscall_number);
@@ -196,7 +269,7 @@ bool create(const char* file, unsigned initial_size) {
     exit(-1);
   }
 
-  char fname[NAME_MAX + 1];
+  char fname[PATH_MAX];
   size_t fname_len = 0;
 
   if (!copy_in_string(fname, file, sizeof fname, &fname_len)) {
@@ -220,7 +293,7 @@ bool remove(const char* file) {
     exit(-1);
   }
 
-  char fname[NAME_MAX + 1];
+  char fname[PATH_MAX];
   size_t fname_len = 0;
 
   if (!copy_in_string(fname, file, sizeof fname, &fname_len)) {
@@ -265,184 +338,412 @@ int write(int fd, const void* buffer, unsigned size) {
   if (fd < 0 || fd >= FDT_SIZE) return -1;
   if ((size == 0) || (buffer == NULL)) return 0;
 
-  const size_t CHUNK_SIZE = 4096;
-
   struct thread* curr = thread_current();
   struct file* file = curr->fdt[fd];
   if (file == NULL || file == STDIN_MARKER) return -1;
 
-  if (file == STDOUT_MARKER) {
-    // 큰 데이터는 청크 단위로 나누어 출력
+  return user_io(file, (void*)buffer, size, -1, false);
+}
 
-    size_t remaining = size;
-    size_t offset = 0;
+int read(int fd, void* buffer, unsigned size) {
+  if (!fd || fd < 0 || fd >= FDT_SIZE) return -1;
+  struct thread* curr = thread_current();
+  struct file* file = curr->fdt[fd];
 
-    while (remaining > 0) {
-      size_t chunk_size = remaining > CHUNK_SIZE ? CHUNK_SIZE : remaining;
+  if (file == NULL || file == STDOUT_MARKER) return -1;
 
-      void* kbuff = palloc_get_page(PAL_ZERO);
-      if (kbuff == NULL) {
-        exit(-1);
-      }
+  return user_io(file, buffer, size, -1, true);
+}
 
-      if (!copy_in(kbuff, (const char*)buffer + offset, chunk_size)) {
-        palloc_free_page(kbuff);
-        exit(-1);
-      }
+/*
+ * user_io()
+ * - 유저 버퍼와 파일(또는 콘솔) 사이에서 size 바이트를 옮긴다.
+ * - 버퍼를 PIN_CHUNK씩 vm_pin_buffer()로 고정한 뒤 유저 주소로 바로
+ *   file_read()/file_write()를 부르므로 바운스 페이지나 바이트 단위 복사가 없다.
+ * - ofs가 0 이상이면 그 위치에서 읽고 쓰며 파일 위치는 바꾸지 않는다.
+ * - 잘못된 버퍼는 exit(-1), 덜 옮겨지면(EOF 등) 거기서 멈추고 옮긴 바이트 수를
+ *   반환한다.
+ */
+static int user_io(struct file* file, void* buffer, size_t size, off_t ofs,
+                   bool is_read) {
+  size_t done = 0;
+
+  while (done < size) {
+    size_t chunk = size - done > PIN_CHUNK ? PIN_CHUNK : size - done;
+    uint8_t* p = (uint8_t*)buffer + done;
+    size_t n;
+
+    if (!vm_pin_buffer(p, chunk, is_read)) exit(-1);
+
+    if (file == STDIN_MARKER) {
+      for (size_t i = 0; i < chunk; i++) p[i] = (uint8_t)input_getc();
+      n = chunk;
+    } else if (file == STDOUT_MARKER) {
+      putbuf((const char*)p, chunk);
+      n = chunk;
+    } else {
+      lock_acquire(&filesys_lock);
+      if (ofs >= 0)
+        n = is_read ? file_read_at(file, p, chunk, ofs + done)
+                    : file_write_at(file, p, chunk, ofs + done);
+      else
+        n = is_read ? file_read(file, p, chunk) : file_write(file, p, chunk);
+      lock_release(&filesys_lock);
+    }
+
+    vm_unpin_buffer(p, chunk);
+    done += n;
+    if (n != chunk) break;
+  }
+  return done;
+}
 
-      putbuf(kbuff, chunk_size);
-      palloc_free_page(kbuff);
+int open(const char* file) {
+  char kname[PATH_MAX];
+  size_t len = 0;
 
-      offset += chunk_size;
-      remaining -= chunk_size;
-    }
-    return size;
+  if (!copy_in_string(kname, file, sizeof kname, &len)) {
+    return -1;
   }
-  size_t remaining = size;
-  size_t offset = 0;
-  int total_written = 0;
 
-  while (remaining > 0) {
-    size_t chunk_size = remaining > CHUNK_SIZE ? CHUNK_SIZE : remaining;
+  kname[len] = '\0';
 
-    void* kbuff = palloc_get_page(PAL_ZERO);
-    if (kbuff == NULL) {
-      exit(-1);
-    }
+  lock_acquire(&filesys_lock);
+  struct file* f = filesys_open(kname);
+  lock_release(&filesys_lock);
 
-    if (!copy_in(kbuff, (const char*)buffer + offset, chunk_size)) {
-      palloc_free_page(kbuff);
-      exit(-1);
-    }
-    lock_acquire(&filesys_lock);
-    int bytes_written = file_write(file, kbuff, chunk_size);
-    lock_release(&filesys_lock);
+  if (f == NULL) {
+    return -1;
+  }
 
-    palloc_free_page(kbuff);
+  struct thread* curr = thread_current();
 
-    if (bytes_written != chunk_size) {
-      total_written += bytes_written;
-      break;
+  for (int fd = 2; fd < FDT_SIZE; fd++) {
+    if (curr->fdt[fd] == NULL) {
+      curr->fdt[fd] = f;
+      return fd;
     }
-
-    total_written += bytes_written;
-    offset += chunk_size;
-    remaining -= chunk_size;
   }
 
-  return total_written;
+  file_close(f);
+  return -1;
 }
 
-int read(int fd, void* buffer, unsigned size) {
-  if (!fd || fd < 0 || fd >= FDT_SIZE) return -1;
-  int bytes_read = 0;
+int filesize(int fd) {
+  if (!fd || fd < 2 || fd >= FDT_SIZE) return -1;
+
   struct thread* curr = thread_current();
   struct file* file = curr->fdt[fd];
 
+  if (file == NULL) return -1;
+
+  return file_length(file);
+}
+
+/* 파일 데이터에 실제로 할당된 섹터 수를 돌려준다.
+ * 구멍이 있거나 inode에 인라인으로 저장된 파일은 filesize보다 작다. */
+int fileblocks(int fd) {
+  if (fd < 2 || fd >= FDT_SIZE) return -1;
+
+  struct file* file = thread_current()->fdt[fd];
+  if (file == NULL || file == STDIN_MARKER || file == STDOUT_MARKER)
+    return -1;
+
+  lock_acquire(&filesys_lock);
+  int blocks = file_blocks(file);
+  lock_release(&filesys_lock);
+  return blocks;
+}
+
+/* 파일의 offset 위치에서 size 바이트를 읽는다.
+ * file_tell() 위치는 바꾸지 않으므로 seek + read를 한 번의 호출로 대신한다. */
+int pread(int fd, void* buffer, unsigned size, off_t offset) {
+  if (fd < 2 || fd >= FDT_SIZE || offset < 0) return -1;
+
+  struct file* file = thread_current()->fdt[fd];
+  if (file == NULL || file == STDIN_MARKER || file == STDOUT_MARKER)
+    return -1;
+
+  if (size > INT_MAX) return -1;
+  return user_io(file, buffer, size, offset, true);
+}
+
+/* 파일의 offset 위치에 size 바이트를 쓴다. file_tell() 위치는 그대로다. */
+int pwrite(int fd, const void* buffer, unsigned size, off_t offset) {
+  if (fd < 2 || fd >= FDT_SIZE || offset < 0) return -1;
+
+  struct file* file = thread_current()->fdt[fd];
+  if (file == NULL || file == STDIN_MARKER || file == STDOUT_MARKER)
+    return -1;
+
+  if (size > INT_MAX) return -1;
+  return user_io(file, (void*)buffer, size, offset, false);
+}
+
+/* iov[0..iovcnt)의 버퍼들을 차례로 채운다.
+ * 모든 iovec을 먼저 검증하고 버퍼를 고정한 뒤 filesys_lock을 한 번만 잡고 읽는다.
+ * 어느 버퍼에서 덜 읽히면(EOF) 거기서 멈추고 지금까지 읽은 바이트 수를 돌려준다. */
+int readv(int fd, const struct iovec* iov, int iovcnt) {
+  if (fd < 0 || fd >= FDT_SIZE) return -1;
+
+  struct file* file = thread_current()->fdt[fd];
   if (file == NULL || file == STDOUT_MARKER) return -1;
 
-  if (file == STDIN_MARKER) {
-    // stdin에서 읽기 전에 버퍼 유효성 검사
-    for (unsigned i = 0; i < size; i++) {
-      if (!is_user_vaddr((uint8_t*)buffer + i)) {
-        exit(-1);
-      }
-      if (check_and_get_page((uint8_t*)buffer + i) == NULL) {
-        exit(-1);
-      }
-    }
+  struct iovec* kiov = copy_in_iovec(iov, iovcnt, true);
+  if (kiov == NULL) return -1;
 
-    // stdin에서 읽기
-    for (unsigned i = 0; i < size; i++) {
-      *((uint8_t*)buffer + i) = (uint8_t)input_getc();
+  int total = 0;
+  if (file == STDIN_MARKER) {
+    for (int i = 0; i < iovcnt; i++) {
+      for (size_t j = 0; j < kiov[i].iov_len; j++)
+        ((uint8_t*)kiov[i].iov_base)[j] = (uint8_t)input_getc();
+      total += kiov[i].iov_len;
     }
-    bytes_read = size;
   } else {
-    // 잘못된 fd인 경우 리턴
-
-    // 버퍼가 유효한 사용자 주소인지 확인
-    for (unsigned i = 0; i < size; i++) {
-      if (!is_user_vaddr((uint8_t*)buffer + i)) {
-        exit(-1);
-      }
-      if (check_and_get_page((uint8_t*)buffer + i) == NULL) {
-        exit(-1);
-      }
+    lock_acquire(&filesys_lock);
+    for (int i = 0; i < iovcnt; i++) {
+      int n = file_read(file, kiov[i].iov_base, kiov[i].iov_len);
+      total += n;
+      if ((size_t)n != kiov[i].iov_len) break;
     }
+    lock_release(&filesys_lock);
+  }
 
-    // 버퍼가 writable인지 확인 (페이지 단위로)
-    for (unsigned i = 0; i < size; i += PGSIZE) {
-      void* page_addr = pg_round_down((uint8_t*)buffer + i);
-      uint64_t* pte = pml4e_walk(curr->pml4, (uint64_t)page_addr, 0);
+  unpin_iovec(kiov, iovcnt);
+  return total;
+}
 
-      // PTE가 없거나 writable이 아니면 종료!
-      if (pte == NULL || !(*pte & PTE_W)) {
-        exit(-1);
-      }
-    }
+/* iov[0..iovcnt)의 버퍼들을 차례로 쓴다. 검증과 잠금은 readv()와 같다. */
+int writev(int fd, const struct iovec* iov, int iovcnt) {
+  if (fd < 0 || fd >= FDT_SIZE) return -1;
 
-    // 마지막 바이트가 속한 페이지도 확인
-    if (size > 0) {
-      void* last_page = pg_round_down((uint8_t*)buffer + size - 1);
-      void* first_page = pg_round_down(buffer);
+  struct file* file = thread_current()->fdt[fd];
+  if (file == NULL || file == STDIN_MARKER) return -1;
 
-      if (last_page != first_page) {
-        uint64_t* pte = pml4e_walk(curr->pml4, (uint64_t)last_page, 0);
-        if (pte == NULL || !(*pte & PTE_W)) {
-          exit(-1);
-        }
-      }
-    }
+  struct iovec* kiov = copy_in_iovec(iov, iovcnt, false);
+  if (kiov == NULL) return -1;
 
-    // file_read() 함수 호출
+  int total = 0;
+  if (file == STDOUT_MARKER) {
+    for (int i = 0; i < iovcnt; i++) {
+      putbuf(kiov[i].iov_base, kiov[i].iov_len);
+      total += kiov[i].iov_len;
+    }
+  } else {
     lock_acquire(&filesys_lock);
-    bytes_read = file_read(file, buffer, size);
+    for (int i = 0; i < iovcnt; i++) {
+      int n = file_write(file, kiov[i].iov_base, kiov[i].iov_len);
+      total += n;
+      if ((size_t)n != kiov[i].iov_len) break;
+    }
     lock_release(&filesys_lock);
   }
 
-  return bytes_read;
+  unpin_iovec(kiov, iovcnt);
+  return total;
 }
 
-int open(const char* file) {
-  char kname[NAME_MAX + 1];
-  size_t len = 0;
+/* 유저의 iovec 배열을 커널로 복사하고 각 버퍼를 vm_pin_buffer()로 고정한다.
+ * iovcnt가 범위를 벗어나거나 길이 합이 int를 넘으면 NULL을 돌려주고,
+ * 잘못된 포인터는 read()/write()와 마찬가지로 프로세스를 종료시킨다.
+ * 돌려받은 배열은 호출자가 unpin_iovec()으로 풀어 준다. */
+static struct iovec* copy_in_iovec(const struct iovec* uiov, int iovcnt,
+                                   bool writable) {
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) return NULL;
+
+  struct iovec* kiov = malloc(iovcnt * sizeof *kiov);
+  if (kiov == NULL) return NULL;
+  if (!copy_from_user(kiov, uiov, iovcnt * sizeof *kiov)) {
+    free(kiov);
+    exit(-1);
+  }
 
-  if (!copy_in_string(kname, file, sizeof kname, &len)) {
-    return -1;
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    total += kiov[i].iov_len;
+    if (kiov[i].iov_len > INT_MAX || total > INT_MAX) {
+      free(kiov);
+      return NULL;
+    }
+  }
+  for (int i = 0; i < iovcnt; i++) {
+    if (!vm_pin_buffer(kiov[i].iov_base, kiov[i].iov_len, writable)) {
+      unpin_iovec(kiov, i);
+      exit(-1);
+    }
   }
+  return kiov;
+}
 
-  kname[len] = '\0';
+/*
+ * copy_file_range()
+ * - fd_in의 off_in 위치에서 fd_out의 off_out 위치로 length 바이트를
+ *   커널 안에서 바로 복사한다. 유저 버퍼를 거치지 않는다.
+ * - 오프셋이 -1이면 해당 파일의 현재 위치를 쓰고, 복사한 만큼 위치를 옮긴다.
+ * - COPY_BATCH 크기의 커널 버퍼 하나로 file_read_at()/file_write_at()을
+ *   거쳐 읽고 쓰며, 배치마다 filesys_lock을 놓아 다른 프로세스가 끼어들 수
+ *   있게 한다.
+ * - 같은 파일 안에서 범위가 겹치거나 범위 끝이 off_t(INT_MAX)를 넘으면 -1.
+ *   소스의 EOF에 닿으면 거기서 멈추고 복사한 바이트 수를 반환한다.
+ */
+int copy_file_range(int fd_in, off_t off_in, int fd_out, off_t off_out,
+                    unsigned length) {
+  struct thread* curr = thread_current();
+
+  if (fd_in < 2 || fd_in >= FDT_SIZE || fd_out < 2 || fd_out >= FDT_SIZE)
+    return -1;
+  if (off_in < -1 || off_out < -1 || length > INT_MAX) return -1;
+
+  struct file* in = curr->fdt[fd_in];
+  struct file* out = curr->fdt[fd_out];
+  if (in == NULL || in == STDIN_MARKER || in == STDOUT_MARKER) return -1;
+  if (out == NULL || out == STDIN_MARKER || out == STDOUT_MARKER) return -1;
+  if (length == 0) return 0;
 
   lock_acquire(&filesys_lock);
-  struct file* f = filesys_open(kname);
+  off_t pos_in = off_in == -1 ? file_tell(in) : off_in;
+  off_t pos_out = off_out == -1 ? file_tell(out) : off_out;
   lock_release(&filesys_lock);
 
-  if (f == NULL) {
+  // 이후의 pos + length, pos + done이 off_t를 넘치지 않게 한다
+  if ((off_t)length > INT_MAX - pos_in || (off_t)length > INT_MAX - pos_out)
+    return -1;
+  if (file_get_inode(in) == file_get_inode(out) &&
+      pos_in < pos_out + (off_t)length && pos_out < pos_in + (off_t)length)
     return -1;
+
+  size_t batch_pages = COPY_BATCH / PGSIZE;
+  uint8_t* buf = palloc_get_multiple(0, batch_pages);
+  if (buf == NULL) {
+    batch_pages = 1;
+    buf = palloc_get_page(0);
+    if (buf == NULL) return -1;
   }
 
-  struct thread* curr = thread_current();
+  size_t done = 0;
+  while (done < length) {
+    size_t chunk = batch_pages * PGSIZE;
+    if (chunk > length - done) chunk = length - done;
 
-  for (int fd = 2; fd < FDT_SIZE; fd++) {
-    if (curr->fdt[fd] == NULL) {
-      curr->fdt[fd] = f;
-      return fd;
-    }
+    lock_acquire(&filesys_lock);
+    off_t n = file_read_at(in, buf, chunk, pos_in + done);
+    if (n > 0) n = file_write_at(out, buf, n, pos_out + done);
+    lock_release(&filesys_lock);
+
+    if (n <= 0) break;
+    done += n;
+    if ((size_t)n != chunk) break;
   }
+  palloc_free_multiple(buf, batch_pages);
 
-  file_close(f);
-  return -1;
+  lock_acquire(&filesys_lock);
+  if (off_in == -1) file_seek(in, pos_in + done);
+  if (off_out == -1) file_seek(out, pos_out + done);
+  lock_release(&filesys_lock);
+  return done;
 }
 
-int filesize(int fd) {
-  if (!fd || fd < 2 || fd >= FDT_SIZE) return -1;
+/* batch()가 쓰는 커널 버퍼. 레코드 하나가 잘못된 포인터로 exit(-1)해도
+ * process_exit()이 해제할 수 있도록 thread의 batch에 걸어 둔다. */
+struct batch_buf {
+  struct intr_frame frame;      // 레코드 하나를 syscall_handler()로 보낼 프레임
+  struct syscall_rec recs[];    // 유저 배열의 사본
+};
+
+/* batch()의 레코드로 실행할 수 있는 시스템 콜 번호인가.
+ * syscall_handler()가 모르는 번호는 프로세스를 죽이므로 미리 거른다.
+ * fork, exec, batch는 프레임을 바꾸거나 돌아오지 않으므로 뺀다. */
+static bool batchable(uint64_t nr) {
+  switch (nr) {
+    case SYS_HALT:
+    case SYS_WAIT:
+    case SYS_CREATE:
+    case SYS_REMOVE:
+    case SYS_OPEN:
+    case SYS_FILESIZE:
+    case SYS_READ:
+    case SYS_WRITE:
+    case SYS_SEEK:
+    case SYS_TELL:
+    case SYS_CLOSE:
+    case SYS_MMAP:
+    case SYS_MUNMAP:
+    case SYS_DUP2:
+    case SYS_MOUNT:
+    case SYS_UMOUNT:
+    case SYS_FILEBLOCKS:
+    case SYS_PREAD:
+    case SYS_PWRITE:
+    case SYS_READV:
+    case SYS_WRITEV:
+    case SYS_COPY_FILE_RANGE:
+    case SYS_IO_SETUP:
+    case SYS_IO_ENTER:
+      return true;
+    default:
+      return false;
+  }
+}
 
+/*
+ * batch()
+ * - 유저 배열 recs의 시스템 콜 cnt개를 순서대로 실행하고, 각 결과를
+ *   recs[i].ret에 돌려준다. 모드 전환은 batch 한 번뿐이다.
+ * - 각 호출은 f를 복사한 프레임에 번호와 인자를 채워 syscall_handler()로
+ *   보내므로, 하나씩 직접 부른 것과 똑같이 동작한다.
+ * - exit는 batch를 끝내고 프로세스를 끝낸다. fork, exec, batch와 모르는
+ *   번호는 batchable()에서 걸러 -1로 거절한다.
+ * - stop_on_error면 결과가 음수인 첫 호출에서 멈춘다.
+ * - 실행한 레코드 수를 반환한다. 배열이 잘못되면 -1.
+ */
+int batch(struct intr_frame* f, struct syscall_rec* recs, int cnt,
+          bool stop_on_error) {
   struct thread* curr = thread_current();
-  struct file* file = curr->fdt[fd];
+  if (cnt <= 0 || cnt > BATCH_MAX) return -1;
+
+  struct batch_buf* buf = malloc(sizeof *buf + cnt * sizeof *buf->recs);
+  if (buf == NULL) return -1;
+  curr->batch = buf;
+  struct syscall_rec* krecs = buf->recs;
+  struct intr_frame* frame = &buf->frame;
+  if (!copy_from_user(krecs, recs, cnt * sizeof *krecs)) exit(-1);
+
+  int done = 0;
+  while (done < cnt) {
+    struct syscall_rec* r = &krecs[done++];
+
+    if (r->nr == SYS_EXIT) {
+      exit((int)r->args[0]);  // 버퍼는 process_exit()이 해제한다
+    } else if (!batchable(r->nr)) {
+      r->ret = -1;
+    } else {
+      *frame = *f;
+      frame->R.rax = r->nr;
+      frame->R.rdi = r->args[0];
+      frame->R.rsi = r->args[1];
+      frame->R.rdx = r->args[2];
+      frame->R.r10 = r->args[3];
+      frame->R.r8 = r->args[4];
+      frame->R.r9 = r->args[5];
+      syscall_handler(frame);
+      // mmap 말고는 int를 돌려주므로 32비트에서 부호 확장한다
+      r->ret = r->nr == SYS_MMAP ? (int64_t)frame->R.rax : (int)frame->R.rax;
+    }
+    if (stop_on_error && r->ret < 0) break;
+  }
 
-  if (file == NULL) return -1;
+  bool ok = copy_to_user(recs, krecs, done * sizeof *krecs);
+  curr->batch = NULL;
+  free(buf);
+  if (!ok) exit(-1);
+  return done;
+}
 
-  return file_length(file);
+/* copy_in_iovec()이 고정한 앞의 iovcnt개 버퍼를 풀고 배열을 해제한다. */
+static void unpin_iovec(struct iovec* kiov, int iovcnt) {
+  for (int i = 0; i < iovcnt; i++)
+    vm_unpin_buffer(kiov[i].iov_base, kiov[i].iov_len);
+  free(kiov);
 }
 
 void close(int fd) {
@@ -482,91 +783,68 @@ int exec(const char* cmd_line) {
   process_exec(kernel_file);
 }
 
-/* 유저 포인터 `usrc`로부터 size 바이트를 커널 버퍼 `dst`로 복사한다.
-   성공하면 true, 실패하면 false를 반환한다. */
-bool copy_in(void* dst, const void* usrc, size_t size) {
-  for (size_t i = 0; i < size; i++) {
-    const void* user_addr = (const char*)usrc + i;
-
-    if (!is_user_vaddr(user_addr)) {
-      return false;
-    }
-
-    void* kva = check_and_get_page(user_addr);
-    if (kva == NULL) {
-      return false;
-    }
-
-    ((char*)dst)[i] = *(char*)kva;
-  }
-  return true;
-}
-
 /*
  * copy_in_string()
  * - 유저 포인터 us가 가리키는 NUL-종단 문자열을 커널 버퍼 dst로 복사한다.
- * - 페이지 경계마다 검증(pml4_get_page)하며 잘못된 포인터/매핑 실패 시
- * exit(-1).
+ * - strncpy_from_user()로 유저 메모리를 직접 읽으며, 잘못된 포인터나
+ *   매핑 실패 시 exit(-1).
  * - dst_sz 바이트 안에서 반드시 '\0'을 만나야 하며, 만나지 못하면 false를
  * 반환(과다 길이).
  * - 성공 시 true를 반환하고, out_len가 비-NULL이면 NUL 제외 길이를 기록한다.
- * - 64비트 주소 체계를 가정한다.
  */
 bool copy_in_string(char* dst, const char* us, size_t dst_sz, size_t* out_len) {
-  /* (1) 파라미터 가드 */
   if (dst == NULL || dst_sz == 0) return false;
-  if (us == NULL || !is_user_vaddr(us)) exit(-1);  // bad ptr → 종료
 
-  struct thread* curr = thread_current();
+  long len = strncpy_from_user(dst, us, dst_sz);
+  if (len < 0) exit(-1);                    // bad ptr → 종료
+  if ((size_t)len == dst_sz) return false;  // 버퍼 초과: NUL을 못 만남
 
-  /* (2) 바이트 단위 복사 */
-  for (size_t i = 0; i < dst_sz; i++) {
-    const char* up = (const char*)us + i;
-
-    if (!is_user_vaddr(up)) exit(-1);  // 커널 경계 넘어가면 종료
-    char* kva = check_and_get_page(up);
-    if (kva == NULL) exit(-1);  // 미매핑 → 종료
+  if (out_len) *out_len = len;
+  return true;
+}
 
-    char c = *kva;  // 안전한 한 바이트 로드
-    dst[i] = c;     // 커널 버퍼에 기록
+pid_t fork(const char* thread_name, struct intr_frame* if_) {
+  // 스레드 이름은 어차피 16바이트로 잘리므로 그만큼만 복사한다
+  char name[16];
+  long len = strncpy_from_user(name, thread_name, sizeof name);
+  if (len < 0) exit(-1);
+  name[sizeof name - 1] = '\0';
 
-    if (c == '\0') {
-      // 문자열 끝
-      if (out_len) *out_len = i;  // 널 전까지 길이
-      return true;
-    }
-  }
+  // 자식 프로세스 생성 (올바른 인터럽트 프레임 전달)
+  pid_t child_pid = process_fork(name, if_);
 
-  /* (3) 버퍼 초과: NUL을 못 만남 */
-  return false;
+  return child_pid;
 }
 
-pid_t fork(const char* thread_name, struct intr_frame* if_) {
-  // 1. 주소 유효성 검사
-  if (thread_name == NULL || !is_user_vaddr(thread_name) ||
-      !pml4_get_page(thread_current()->pml4, thread_name)) {
-    exit(-1);
-  }
+int wait(pid_t pid) { return process_wait(pid); }
 
-  // 2. 전체 문자열 유효성 검사
-  int len = 0;
-  int MAX_LEN = 16;  // 최대 길이 제한(16자)
-  while (len < MAX_LEN) {
-    if (!is_user_vaddr(thread_name + len) ||
-        !pml4_get_page(thread_current()->pml4, thread_name + len)) {
-      exit(-1);
-    }
-    if (thread_name[len] == '\0') break;
-    len++;
-  }
+/* 디스크 hdCHAN_NO:DEV_NO의 파일 시스템을 PATH에 mount한다.
+ * 파일 시스템이 없는 디스크는 format하지 않고 실패한다. 성공하면 0, 실패하면 -1. */
+int mount(const char* path, int chan_no, int dev_no) {
+  char kpath[PATH_MAX];
 
-  // 3. 자식 프로세스 생성 (올바른 인터럽트 프레임 전달)
-  pid_t child_pid = process_fork(thread_name, if_);
+  if (!copy_in_string(kpath, path, sizeof kpath, NULL)) return -1;
 
-  return child_pid;
+  lock_acquire(&filesys_lock);
+  bool ok = filesys_mount(kpath, chan_no, dev_no);
+  lock_release(&filesys_lock);
+
+  return ok ? 0 : -1;
 }
 
-int wait(pid_t pid) { return process_wait(pid); }
+/* PATH에 mount된 파일 시스템을 내린다. 열린 파일이 남아 있으면 실패.
+ * 성공하면 0, 실패하면 -1. */
+int umount(const char* path) {
+  char kpath[PATH_MAX];
+
+  if (!copy_in_string(kpath, path, sizeof kpath, NULL)) return -1;
+
+  lock_acquire(&filesys_lock);
+  bool ok = filesys_umount(kpath);
+  lock_release(&filesys_lock);
+
+  return ok ? 0 : -1;
+}
 
 int dup2(int oldfd, int newfd) {
   if (oldfd < 0 || oldfd >= FDT_SIZE) return -1;
@@ -588,43 +866,3 @@ int dup2(int oldfd, int newfd) {
 
   return newfd;
 }
-
-void* check_and_get_page(const void* uaddr) {
-  // 1. User 주소 범위 확인
-  if (!is_user_vaddr(uaddr)) {
-    return NULL;
-  }
-
-  struct thread* curr = thread_current();
-
-  // 2. 페이지 매핑 확인
-  void* kva = pml4_get_page(curr->pml4, uaddr);
-
-  // 3. 매핑되어 있으면 바로 반환
-  if (kva != NULL) {
-    return kva;
-  }
-
-  // SPT에서 페이지 찾기
-  void* page_addr = pg_round_down(uaddr);
-  struct page* page = spt_find_page(&curr->spt, page_addr);
-
-  if (page != NULL) {
-    // SPT에 있음 -> Lazy loading 필요
-    if (vm_claim_page(page_addr)) {
-      kva = pml4_get_page(curr->pml4, uaddr);
-      return kva;
-    }
-    // Claim 실패
-    return NULL;
-  }
-
-  // SPT에서 못찾으면 stack growth 시도
-  if (is_valid_stack_access(page_addr, (uintptr_t)curr->user_rsp)) {
-    vm_stack_growth(page_addr);
-    kva = pml4_get_page(curr->pml4, uaddr);
-    return kva;
-  }
-
-  return NULL;  // 모두 실패
-}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "userprog/uaccess.h"
+
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+size_t copy_user_raw(void* dst, const void* src, size_t n);
+long strncpy_user_raw(char* dst, const char* src, size_t n);
+
+/* 링커 스크립트가 __ex_table 섹션의 시작과 끝에 붙이는 심볼 */
+extern const struct exception_entry __start_ex_table[];
+extern const struct exception_entry __stop_ex_table[];
+
+/* [uaddr, uaddr + size)가 통째로 유저 영역 안에 있는지 확인한다.
+ * 커널 주소는 폴트가 나지 않으므로 접근 전에 반드시 걸러야 한다. */
+static bool user_range_ok(const void* uaddr, size_t size) {
+  uintptr_t start = (uintptr_t)uaddr;
+  return start < KERN_BASE && size <= KERN_BASE - start;
+}
+
+/* 유저 주소 usrc에서 size 바이트를 dst로 복사한다.
+ * 잘못된 주소가 섞여 있으면 false. */
+bool copy_from_user(void* dst, const void* usrc, size_t size) {
+  if (!user_range_ok(usrc, size)) return false;
+  return copy_user_raw(dst, usrc, size) == 0;
+}
+
+/* src의 size 바이트를 유저 주소 udst로 복사한다.
+ * CR0.WP가 꺼져 있어 커널은 읽기 전용 페이지에도 폴트 없이 쓸 수 있으므로,
+ * 대상 페이지들이 쓰기 가능한지는 SPT로 먼저 확인한다. */
+bool copy_to_user(void* udst, const void* src, size_t size) {
+  struct supplemental_page_table* spt = &thread_current()->spt;
+
+  if (!user_range_ok(udst, size)) return false;
+  if (size == 0) return true;
+
+  uint8_t* last = (uint8_t*)udst + size - 1;
+  for (uint8_t* p = pg_round_down(udst); p <= last; p += PGSIZE) {
+    struct page* page = spt_find_page(spt, p);
+    if (page != NULL && !page->writable) return false;
+  }
+  return copy_user_raw(udst, src, size) == 0;
+}
+
+/* 유저 문자열 usrc를 최대 size 바이트까지 dst로 복사한다.
+ * NUL을 만나면 그 길이를, size 안에 NUL이 없으면 size를,
+ * 잘못된 주소면 -1을 반환한다. */
+long strncpy_from_user(char* dst, const char* usrc, size_t size) {
+  uintptr_t start = (uintptr_t)usrc;
+
+  if (start >= KERN_BASE) return -1;
+  if (size > KERN_BASE - start) {
+    /* 유저 영역 끝까지만 읽는다. 거기서도 NUL이 없으면 잘못된 문자열이다. */
+    long len = strncpy_user_raw(dst, usrc, KERN_BASE - start);
+    return len == (long)(KERN_BASE - start) ? -1 : len;
+  }
+  return strncpy_user_raw(dst, usrc, size);
+}
+
+/* 커널 모드에서 폴트가 난 명령(f->rip)이 예외 테이블에 있으면
+ * f->rip를 fixup 주소로 바꾸고 true를 반환한다. */
+bool exception_fixup(struct intr_frame* f) {
+  for (const struct exception_entry* e = __start_ex_table;
+       e < __stop_ex_table; e++) {
+    if (e->insn == f->rip) {
+      f->rip = e->fixup;
+      return true;
+    }
+  }
+  return false;
+}
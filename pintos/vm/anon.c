@@ -1,7 +1,18 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "kernel/bitmap.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "vm/vm.h"
 
@@ -19,70 +30,326 @@ static const struct page_operations anon_ops = {
     .type = VM_ANON,
 };
 
-struct swap_anon *find_blank_swap();
-
-/* 디스크에서 사용 가능한 swap slot과 사용 불가능한 swap slot을
-  관리하는 자료구조
-  bitmap 구조체 사용
-    - bit를 저장하는 연속된 메모리 공간 위의 배열 객체
-    - 각각의 비트가 swap_slot과 매칭, 1인 경우 swap out되어
-    디스크의 swap 공간에 임시 저장되었다는 뜻 */
-struct bitmap *swap_table;
-
 /* PGSZIE == 1<<12byte (4kb) / DISK_SECTOR_SIZE == 512byte
   SECTOR_PER_PAGE == 8 */
 const size_t SECTOR_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE;
 
-struct list swap_list;
+/* 등록된 swap 장치들, priority 내림차순.
+  swap_lock이 목록과 각 장치의 bitmap, 통계를 보호한다. */
+static struct list swap_devices;
+static struct lock swap_lock;
+
+/* 마지막으로 slot을 내준 장치. 같은 priority 안에서 다음 장치부터
+  할당해 round-robin이 되게 한다. */
+static struct swap_device *swap_last;
+
+/* 부팅 옵션 -swap=CHAN:DEV[:PRIO]로 지정된 swap 디스크들 */
+#define SWAP_OPTION_MAX 4
+static struct swap_option {
+  int chan_no, dev_no, priority;
+} swap_options[SWAP_OPTION_MAX];
+static int swap_option_cnt;
+
+/* 부팅 옵션 -swapfile=NAME[:PAGES[:PRIO]]로 지정된 swap 파일.
+  swap_file_pages가 0이면 이미 있는 파일을 그 크기대로 쓴다. */
+static char swap_file_name[64];
+static int swap_file_pages;
+static int swap_file_priority;
+
+/* swap 파일의 extent는 활성화할 때 한 번만 구한다. 파일은 쓰기 금지인
+  채로 계속 열어 두므로 그동안 extent가 바뀌지 않고, swap I/O는 파일
+  시스템을 거치지 않고 파일이 있는 디스크에 바로 한다. */
+#define SWAP_EXTENT_MAX 64
+struct swap_file {
+  struct file *file;
+  struct disk *disk;  // 파일이 있는 파일 시스템의 디스크
+  size_t extent_cnt;
+  struct inode_extent extents[SWAP_EXTENT_MAX];  // 파일 순서대로
+};
+
+static void swap_file_activate(void);
+static bool disk_swap_read(struct swap_device *dev, size_t slot, void *kva);
+static bool disk_swap_write(struct swap_device *dev, size_t slot, const void *kva);
+static bool file_swap_read(struct swap_device *dev, size_t slot, void *kva);
+static bool file_swap_write(struct swap_device *dev, size_t slot, const void *kva);
+
+/* 디스크 전체를 slot 배열로 쓰는 swap 장치 */
+static const struct swap_device_ops disk_swap_ops = {
+    .read = disk_swap_read,
+    .write = disk_swap_write,
+};
+
+/* 파일 시스템 위의 swap 파일을 slot 배열로 쓰는 swap 장치 */
+static const struct swap_device_ops file_swap_ops = {
+    .read = file_swap_read,
+    .write = file_swap_write,
+};
 
 /* Initialize the data for anonymous pages */
 void vm_anon_init(void) {
   /* TODO: Set up the swap_disk. */
-  list_init(&swap_list);
+  list_init(&swap_devices);
+  lock_init(&swap_lock);
+
+  /* hd1:1은 옵션에 없어도 priority 0으로 항상 사용한다. */
   swap_disk = disk_get(1, 1);
-  disk_sector_t max_sector_size = disk_size(swap_disk);
-  for (int i = 0; i < max_sector_size; i += SECTOR_PER_PAGE) {
-    struct swap_anon *swap_anon = malloc(sizeof(struct swap_anon));
-    swap_anon->page = NULL;
-    swap_anon->use = false;
-    for (int j = 0; j < SECTOR_PER_PAGE; j++) {
-      swap_anon->sector[j] = i + j;
+  bool have_default = false;
+  for (int i = 0; i < swap_option_cnt; i++) {
+    struct swap_option *o = &swap_options[i];
+    struct disk *d = disk_get(o->chan_no, o->dev_no);
+    if (d == NULL) {
+      printf("swap: no disk hd%d:%d\n", o->chan_no, o->dev_no);
+      continue;
+    }
+    if (d == swap_disk) have_default = true;
+    char name[16];
+    snprintf(name, sizeof name, "hd%d:%d", o->chan_no, o->dev_no);
+    swap_add_device(name, &disk_swap_ops, d, disk_size(d) / SECTOR_PER_PAGE, o->priority);
+  }
+  if (swap_disk != NULL && !have_default)
+    swap_add_device("hd1:1", &disk_swap_ops, swap_disk, disk_size(swap_disk) / SECTOR_PER_PAGE, 0);
+
+  /* vm_init()은 filesys_init() 다음에 불리므로 파일 시스템을 쓸 수 있다. */
+  swap_file_activate();
+}
+
+/* swap 장치를 등록한다. 장치는 SLOT_CNT개의 페이지 slot을 가지며
+  OPS로 읽고 쓴다. 실패하면 NULL. */
+struct swap_device *swap_add_device(const char *name, const struct swap_device_ops *ops,
+                                    void *aux, size_t slot_cnt, int priority) {
+  struct swap_device *dev = calloc(1, sizeof *dev);
+  if (dev == NULL) return NULL;
+  dev->used = bitmap_create(slot_cnt);
+  if (dev->used == NULL) {
+    free(dev);
+    return NULL;
+  }
+  strlcpy(dev->name, name, sizeof dev->name);
+  dev->ops = ops;
+  dev->aux = aux;
+  dev->slot_cnt = slot_cnt;
+  dev->priority = priority;
+
+  /* priority 내림차순, 같은 priority는 등록 순서대로 */
+  lock_acquire(&swap_lock);
+  struct list_elem *e;
+  for (e = list_begin(&swap_devices); e != list_end(&swap_devices); e = list_next(e))
+    if (list_entry(e, struct swap_device, elem)->priority < priority) break;
+  list_insert(e, &dev->elem);
+  lock_release(&swap_lock);
+  return dev;
+}
+
+/* 디스크 D 전체가 swap 장치로 쓰이고 있으면 true.
+  그런 디스크는 파일 시스템으로 mount하면 안 된다. */
+bool swap_uses_disk(struct disk *d) {
+  bool found = false;
+
+  lock_acquire(&swap_lock);
+  for (struct list_elem *e = list_begin(&swap_devices); e != list_end(&swap_devices);
+       e = list_next(e)) {
+    struct swap_device *dev = list_entry(e, struct swap_device, elem);
+    if (dev->ops == &disk_swap_ops && dev->aux == d) found = true;
+  }
+  lock_release(&swap_lock);
+  return found;
+}
+
+/* *S에서 10진수 정수 하나를 읽어 *VALUE에 넣고 *S를 그 뒤로 옮긴다.
+  int 범위를 넘으면 false. */
+static bool parse_int(const char **s, int *value) {
+  bool neg = **s == '-';
+  if (neg) (*s)++;
+  if (!isdigit(**s)) return false;
+  for (*value = 0; isdigit(**s); (*s)++) {
+    int digit = **s - '0';
+    if (*value > (INT_MAX - digit) / 10) return false;  // int를 넘친다
+    *value = *value * 10 + digit;
+  }
+  if (neg) *value = -*value;
+  return true;
+}
+
+/* 부팅 옵션 "-swap=CHAN:DEV[:PRIO]"의 값 OPTION을 기록해 두었다가
+  vm_anon_init()에서 그 디스크를 swap 장치로 등록한다.
+  채널 0에는 커널과 파일 시스템이 있고 hd1:0은 파일을 주고받는 scratch
+  디스크라서 쓸 수 없으므로, 지금은 hd1:1의 priority를 정하는 데만 쓴다.
+  다른 장치는 -swapfile로 더한다. */
+bool swap_parse_option(const char *option) {
+  int chan_no, dev_no, priority = 0;
+
+  if (option == NULL || swap_option_cnt >= SWAP_OPTION_MAX) return false;
+  if (!parse_int(&option, &chan_no) || *option++ != ':' || !parse_int(&option, &dev_no))
+    return false;
+  if (*option == ':') {
+    option++;
+    if (!parse_int(&option, &priority)) return false;
+  }
+  if (*option != '\0' || chan_no != 1 || dev_no != 1) return false;
+
+  swap_options[swap_option_cnt++] = (struct swap_option){chan_no, dev_no, priority};
+  return true;
+}
+
+/* swap 파일의 최대 페이지 수. 파일 크기가 off_t(int)를 넘지 않아야 한다. */
+#define SWAP_FILE_PAGES_MAX (INT_MAX / PGSIZE)
+
+/* 부팅 옵션 "-swapfile=NAME[:PAGES[:PRIO]]"의 값 OPTION을 기록해 둔다.
+  PAGES를 주면 파일을 그 크기로 만들고, 크기가 다르면 다시 만든다.
+  PAGES는 SWAP_FILE_PAGES_MAX 이하여야 한다. */
+bool swap_parse_file_option(const char *option) {
+  const char *colon;
+  int pages = 0, priority = 0;
+
+  if (option == NULL || *option == '\0' || *option == ':') return false;
+  colon = strchr(option, ':');
+  if (colon != NULL) {
+    const char *s = colon + 1;
+    if (!parse_int(&s, &pages) || pages <= 0 || pages > SWAP_FILE_PAGES_MAX) return false;
+    if (*s == ':') {
+      s++;
+      if (!parse_int(&s, &priority)) return false;
     }
-    list_push_back(&swap_list, &swap_anon->swap_elem);
+    if (*s != '\0') return false;
+  }
+
+  size_t len = colon != NULL ? (size_t)(colon - option) : strlen(option);
+  if (len >= sizeof swap_file_name) return false;
+  memcpy(swap_file_name, option, len);
+  swap_file_name[len] = '\0';
+  swap_file_pages = pages;
+  swap_file_priority = priority;
+  return true;
+}
+
+/* -swapfile로 지정된 파일을 (필요하면 새로) 만들고 연 뒤 extent map을
+  구해 swap 장치로 등록한다. 실패하면 알리고 그 파일 없이 계속한다. */
+static void swap_file_activate(void) {
+  const char *name = swap_file_name;
+  off_t size = (off_t)swap_file_pages * PGSIZE;
+
+  if (name[0] == '\0') return;
+
+  /* 크기가 바뀌었으면 지우고 새로 만들어야 연속된 공간을 다시 받는다. */
+  struct file *file = filesys_open(name);
+  if (file != NULL && size != 0 && file_length(file) != size) {
+    file_close(file);
+    file = NULL;
+    filesys_remove(name);
+  }
+  if (file == NULL) {
+    if (size == 0) {
+      printf("swap: %s does not exist\n", name);
+      return;
+    }
+    if (!filesys_create(name, size) || (file = filesys_open(name)) == NULL) {
+      printf("swap: cannot create %s\n", name);
+      return;
+    }
+  }
+
+  struct swap_file *sf = malloc(sizeof *sf);
+  size_t slot_cnt = file_length(file) / PGSIZE;
+  if (sf != NULL)
+    sf->extent_cnt = inode_extents(file_get_inode(file), sf->extents, SWAP_EXTENT_MAX);
+  if (sf == NULL || sf->extent_cnt == 0 || slot_cnt == 0) {
+    printf("swap: cannot map %s (holes or more than %d extents)\n", name, SWAP_EXTENT_MAX);
+    free(sf);
+    file_close(file);
+    return;
+  }
+  sf->file = file;
+  sf->disk = inode_get_fs(file_get_inode(file))->disk;
+  file_deny_write(file);
+
+  if (swap_add_device(name, &file_swap_ops, sf, slot_cnt, swap_file_priority) == NULL) {
+    file_allow_write(file);
+    file_close(file);
+    free(sf);
   }
 }
 
 /* Initialize the file mapping */
-bool anon_initializer(struct page *page, enum vm_type type, void *kva) {
+bool anon_initializer(struct page *page, enum vm_type type UNUSED, void *kva UNUSED) {
   /* Set up the handler */
   page->operations = &anon_ops;
   struct anon_page *anon_page = &page->anon;
+  anon_page->swap_dev = NULL;
 
   return true;
 }
 
+/* 빈 slot을 하나 할당해 그 장치를 반환하고 *SLOT에 번호를 넣는다.
+  빈 slot이 있는 가장 높은 priority의 장치들 중에서, 마지막으로 쓴
+  장치 다음 장치부터 차례로 고른다. swap 공간이 가득 차면 NULL. */
+static struct swap_device *swap_alloc(size_t *slot) {
+  struct swap_device *dev = NULL;
+  struct list_elem *e;
+
+  lock_acquire(&swap_lock);
+  for (e = list_begin(&swap_devices); e != list_end(&swap_devices); e = list_next(e)) {
+    dev = list_entry(e, struct swap_device, elem);
+    if (dev->used_cnt < dev->slot_cnt) break;
+  }
+  if (e == list_end(&swap_devices)) {
+    lock_release(&swap_lock);
+    return NULL;
+  }
+
+  /* dev와 priority가 같은 장치들 중 swap_last 다음부터 찾는다. */
+  if (swap_last != NULL && swap_last->priority == dev->priority) {
+    for (e = list_next(&swap_last->elem); e != list_end(&swap_devices); e = list_next(e)) {
+      struct swap_device *next = list_entry(e, struct swap_device, elem);
+      if (next->priority != dev->priority) break;
+      if (next->used_cnt < next->slot_cnt) {
+        dev = next;
+        break;
+      }
+    }
+  }
+
+  *slot = bitmap_scan_and_flip(dev->used, 0, 1, false);
+  ASSERT(*slot != BITMAP_ERROR);
+  dev->used_cnt++;
+  swap_last = dev;
+  lock_release(&swap_lock);
+  return dev;
+}
+
+/* DEV의 SLOT을 반납한다. */
+static void swap_free(struct swap_device *dev, size_t slot) {
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(dev->used, slot));
+  bitmap_reset(dev->used, slot);
+  dev->used_cnt--;
+  lock_release(&swap_lock);
+}
+
+/* DEV에서 한 번의 I/O가 START부터 걸렸음을 통계에 더한다. */
+static void swap_account(struct swap_device *dev, bool out, uint64_t start) {
+  uint64_t elapsed = timer_usec() - start;
+
+  lock_acquire(&swap_lock);
+  if (out)
+    dev->swap_outs++;
+  else
+    dev->swap_ins++;
+  dev->io_us += elapsed;
+  lock_release(&swap_lock);
+}
+
 /* Swap in the page by read contents from the swap disk. */
 static bool anon_swap_in(struct page *page, void *kva) {
   struct anon_page *anon_page = &page->anon;
-  struct swap_anon *swap_anon = anon_page->swap_anon;
-  for (int i = 0; i < SECTOR_PER_PAGE; i++) {
-    disk_read(swap_disk, swap_anon->sector[i], (uint8_t *)kva + DISK_SECTOR_SIZE * i);
-  }
-  anon_page->swap_anon = NULL;
-  swap_anon->use = false;
+  struct swap_device *dev = anon_page->swap_dev;
+  uint64_t start = timer_usec();
 
-  return true;
-}
+  if (dev == NULL || !dev->ops->read(dev, anon_page->swap_slot, kva)) return false;
+  swap_account(dev, false, start);
+  swap_free(dev, anon_page->swap_slot);
+  anon_page->swap_dev = NULL;
 
-struct swap_anon *find_blank_swap() {
-  struct list_elem *e = list_head(&swap_list);
-  while ((e = list_next(e)) != list_end(&swap_list)) {
-    struct swap_anon *swap_anon = list_entry(e, struct swap_anon, swap_elem);
-    if (!swap_anon->use) {
-      return swap_anon;
-    }
-  }
-  return NULL;
+  return true;
 }
 
 /* Swap out the page by writing contents to the swap disk.
@@ -91,15 +358,19 @@ ANON 페이지를 스왑 아웃한다.
 저장한다.*/
 static bool anon_swap_out(struct page *page) {
   struct anon_page *anon_page = &page->anon;
-  struct swap_anon *swap_anon = find_blank_swap();
-  if (swap_anon == NULL) return false;
+  size_t slot;
+  struct swap_device *dev = swap_alloc(&slot);
+  if (dev == NULL) return false;
 
-  for (int i = 0; i < SECTOR_PER_PAGE; i++) {
-    disk_write(swap_disk, swap_anon->sector[i], (uint8_t *)page->frame->kva + DISK_SECTOR_SIZE * i);
+  uint64_t start = timer_usec();
+  if (!dev->ops->write(dev, slot, page->frame->kva)) {
+    swap_free(dev, slot);
+    return false;
   }
+  swap_account(dev, true, start);
 
-  swap_anon->use = true;
-  anon_page->swap_anon = swap_anon;
+  anon_page->swap_dev = dev;
+  anon_page->swap_slot = slot;
   struct thread *owner = page->owner;
   uint64_t *pml4 = owner ? owner->pml4 : thread_current()->pml4;
   pml4_clear_page(pml4, page->va);
@@ -113,4 +384,68 @@ static bool anon_swap_out(struct page *page) {
 static void
 anon_destroy(struct page *page) {
   struct anon_page *anon_page = &page->anon;
-}
\ No newline at end of file
+
+  /* swap out된 채로 해제되는 페이지는 slot을 돌려준다. */
+  if (anon_page->swap_dev != NULL) {
+    swap_free(anon_page->swap_dev, anon_page->swap_slot);
+    anon_page->swap_dev = NULL;
+  }
+}
+
+/* slot들은 디스크 앞에서부터 SECTOR_PER_PAGE개씩 연속이므로
+  한 번의 multi-sector 요청으로 읽고 쓴다. */
+static bool disk_swap_read(struct swap_device *dev, size_t slot, void *kva) {
+  disk_read_multi(dev->aux, slot * SECTOR_PER_PAGE, SECTOR_PER_PAGE, kva);
+  return true;
+}
+
+static bool disk_swap_write(struct swap_device *dev, size_t slot, const void *kva) {
+  disk_write_multi(dev->aux, slot * SECTOR_PER_PAGE, SECTOR_PER_PAGE, kva);
+  return true;
+}
+
+/* swap 파일의 SLOT을 읽거나 쓴다. slot이 extent 경계에 걸치면
+  나눠서 옮긴다. */
+static bool file_swap_io(struct swap_device *dev, size_t slot, void *kva, bool write) {
+  struct swap_file *sf = dev->aux;
+  size_t ofs = slot * SECTOR_PER_PAGE;  // 파일 안의 sector 위치
+  size_t left = SECTOR_PER_PAGE;
+  uint8_t *p = kva;
+
+  for (size_t i = 0; i < sf->extent_cnt && left > 0; i++) {
+    const struct inode_extent *ext = &sf->extents[i];
+    if (ofs >= ext->cnt) {
+      ofs -= ext->cnt;
+      continue;
+    }
+    size_t n = ext->cnt - ofs < left ? ext->cnt - ofs : left;
+    disk_transfer(sf->disk, ext->start + ofs, n, p, write, DISK_ORIGIN_SWAP);
+    p += n * DISK_SECTOR_SIZE;
+    left -= n;
+    ofs = 0;
+  }
+  return left == 0;
+}
+
+static bool file_swap_read(struct swap_device *dev, size_t slot, void *kva) {
+  return file_swap_io(dev, slot, kva, false);
+}
+
+static bool file_swap_write(struct swap_device *dev, size_t slot, const void *kva) {
+  return file_swap_io(dev, slot, (void *)kva, true);
+}
+
+/* 장치별 사용량과 처리량을 출력한다. */
+void swap_print_stats(void) {
+  struct list_elem *e;
+
+  for (e = list_begin(&swap_devices); e != list_end(&swap_devices); e = list_next(e)) {
+    struct swap_device *dev = list_entry(e, struct swap_device, elem);
+    long long pages = dev->swap_outs + dev->swap_ins;
+    long long kbps = dev->io_us > 0 ? pages * (PGSIZE / 1024) * 1000000LL / dev->io_us : 0;
+
+    printf("swap %s: priority %d, %zu of %zu slots used, %lld out, %lld in, %lld kB/s\n",
+           dev->name, dev->priority, dev->used_cnt, dev->slot_cnt, dev->swap_outs,
+           dev->swap_ins, kbps);
+  }
+}
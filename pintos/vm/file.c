@@ -6,6 +6,7 @@
 #include "threads/synch.h"     // filesys_lock
 #include "threads/thread.h"    // thread_current(), pml4
 #include "threads/vaddr.h"     // PGSIZE
+#include "userprog/aio.h"      // aio_drain
 #include "userprog/process.h"  // struct vm_load_arg
 #include "userprog/syscall.h"
 #include "vm/vm.h"
@@ -257,7 +258,11 @@ void do_munmap(void *addr) {
     return;  // 해당 주소에 매핑이 없음
   }
 
-  // 2. 모든 페이지를 해제
+  // 2. 진행 중인 비동기 I/O가 이 영역을 고정하고 있을 수 있으므로 먼저 끝낸다.
+  //    고정된 프레임을 해제하면 워커가 해제된 프레임에 쓰게 된다.
+  aio_drain();
+
+  // 3. 모든 페이지를 해제
   for (size_t i = 0; i < region->page_count; i++) {
     void *page_addr = addr + (i * PGSIZE);
     struct page *page = spt_find_page(&curr->spt, page_addr);
@@ -268,12 +273,12 @@ void do_munmap(void *addr) {
     }
   }
 
-  // 3. 파일 닫기 (조건부)
+  // 4. 파일 닫기 (조건부)
   if (file_should_close(region->file)) {
     file_close(region->file);
   }
 
-  // 4. region을 리스트에서 제거 및 메모리 해제
+  // 5. region을 리스트에서 제거 및 메모리 해제
   list_remove(&region->elem);
   free(region);
 }
\ No newline at end of file
@@ -147,8 +147,11 @@ bool spt_insert_page(struct supplemental_page_table *spt UNUSED,
  * - 단순히 해시에서 제거하는 게 아니라,
  *   page에 연결된 자원(프레임, 메모리 등)을 해제해야 한다.
  * - vm_dealloc_page()를 호출해 파괴(destroy) 및 free까지 진행.
+ * - 페이지가 vm_pin_buffer()로 고정되어 있으면 안 된다.
  */
 void spt_remove_page(struct supplemental_page_table *spt, struct page *page) {
+  // 고정된 페이지는 I/O가 끝나 풀린 뒤에만 없앨 수 있다 (aio_drain() 참고)
+  ASSERT(page->frame == NULL || page->frame->pin_cnt == 0);
   hash_delete(&spt->spt_hash, &page->hash_elem);
   vm_dealloc_page(page);
 }
@@ -170,7 +173,7 @@ static struct frame *vm_get_victim(void) {
     next = list_next(next);
     if (next == list_end(&frame_table)) next = list_begin(&frame_table);
 
-    if (f == NULL || f->page == NULL || f->pinned) continue;
+    if (f == NULL || f->page == NULL || f->pinned || f->pin_cnt > 0) continue;
 
     struct page *p = f->page;
     struct thread *owner = p->owner;
@@ -180,6 +183,8 @@ static struct frame *vm_get_victim(void) {
       continue;
     }
     // accessed == 0 victim
+    // 축출이 끝날 때까지 다른 축출자나 vm_pin_buffer()가 잡지 못하게 한다
+    f->pinned = true;
     lock_release(&frame_lock);
     return f;
   }
@@ -194,7 +199,10 @@ static struct frame *vm_evict_frame(void) {
   if (victim == NULL) return NULL;
 
   if (victim->page) {
-    if (!swap_out(victim->page)) return NULL;
+    if (!swap_out(victim->page)) {
+      victim->pinned = false;
+      return NULL;
+    }
   }
   // victim 프레임은 frame_table에 그대로 남겨 재사용
   return victim;
@@ -241,6 +249,7 @@ static struct frame *vm_get_frame(void) {
    *    따라서 초기값으로 NULL을 설정. */
   frame->page = NULL;
   frame->pinned = false;
+  frame->pin_cnt = 0;
 
   /* 6. 방금 만든 프레임은 페이지와 연결되지 않은 상태여야 한다는 검증 */
   ASSERT(frame->page == NULL);
@@ -311,7 +320,10 @@ bool vm_try_handle_fault(struct intr_frame *f, void *addr, bool user, bool write
   }
 
   // rsp 근처인지, stack 영역인지, 1MB 제한을 넘었는지 (1 << 20 = 1MB)
-  if (is_valid_stack_access(addr, f->rsp)) {
+  // 커널이 유저 메모리를 건드리다 난 폴트면 f->rsp는 커널 스택이므로
+  // 시스템 콜 진입 때 저장한 유저 rsp로 판단한다.
+  uintptr_t rsp = user ? f->rsp : (uintptr_t)thread_current()->user_rsp;
+  if (is_valid_stack_access(addr, rsp)) {
     vm_stack_growth(addr);
     return true;
   }
@@ -362,11 +374,11 @@ static bool vm_do_claim_page(struct page *page) {
   /* 2. 양방향 연결 설정
    *    - frame이 어떤 page에 속하는지 기록
    *    - page가 어떤 frame을 사용하는지 기록 */
+  frame->pinned = true;
   frame->page = page;
   page->frame = frame;
   page->owner = thread_current();
 
-  frame->pinned = true;
   /* 3. 페이지 테이블에 (page->va → frame->kva) 매핑 추가
    *    - pml4_set_page: 현재 스레드의 pml4(Page Map Level 4, top-level PT)에
    *      가상주소와 물리주소를 매핑한다.
@@ -383,6 +395,95 @@ static bool vm_do_claim_page(struct page *page) {
   return ok;
 }
 
+/*
+ * vm_pin_page()
+ *
+ * - 유저 주소 va가 속한 페이지를 프레임에 올리고 pin_cnt를 올려
+ *   축출되지 않게 고정한다.
+ * - 아직 없는 스택 페이지는 페이지 폴트 때처럼 스택을 늘려 만든다.
+ * - write가 참이면 쓰기 가능한 페이지여야 한다.
+ * - 축출이나 적재가 진행 중인 프레임은 끝날 때까지 양보하며 다시 시도한다.
+ */
+static bool vm_pin_page(const void *va, bool write) {
+  struct thread *curr = thread_current();
+  void *page_addr = pg_round_down(va);
+
+  if (!is_user_vaddr(va)) return false;
+
+  for (;;) {
+    struct page *page = spt_find_page(&curr->spt, page_addr);
+    if (page == NULL) {
+      if (!is_valid_stack_access((void *)va, (uintptr_t)curr->user_rsp))
+        return false;
+      vm_stack_growth(page_addr);
+      continue;
+    }
+    if (write && !page->writable) return false;
+
+    lock_acquire(&frame_lock);
+    struct frame *frame = page->frame;
+    if (frame != NULL && !frame->pinned) {
+      frame->pin_cnt++;
+      lock_release(&frame_lock);
+      return true;
+    }
+    lock_release(&frame_lock);
+
+    if (frame == NULL) {
+      if (!vm_do_claim_page(page)) return false;
+    } else {
+      thread_yield();
+    }
+  }
+}
+
+/* vm_pin_page()로 고정한 va의 페이지를 풀어 준다. */
+static void vm_unpin_page(const void *va) {
+  struct page *page = spt_find_page(&thread_current()->spt, pg_round_down(va));
+
+  ASSERT(page != NULL && page->frame != NULL);
+  lock_acquire(&frame_lock);
+  ASSERT(page->frame->pin_cnt > 0);
+  page->frame->pin_cnt--;
+  lock_release(&frame_lock);
+}
+
+/*
+ * vm_pin_buffer()
+ *
+ * - 유저 버퍼 [buffer, buffer + size)가 걸친 모든 페이지를 고정한다.
+ * - 고정된 동안은 페이지 폴트 없이 유저 주소로 바로 읽고 쓸 수 있으므로,
+ *   시스템 콜이 바운스 페이지 없이 파일 I/O를 할 수 있다.
+ * - 하나라도 실패하면 이미 고정한 페이지를 풀고 false를 반환한다.
+ * - 성공하면 호출자가 같은 인자로 vm_unpin_buffer()를 불러야 한다.
+ */
+bool vm_pin_buffer(const void *buffer, size_t size, bool write) {
+  const uint8_t *first = buffer;
+  const uint8_t *last = first + size - 1;
+
+  if (size == 0) return true;
+  if (last < first || !is_user_vaddr(last)) return false;
+
+  for (const uint8_t *p = first; p <= last;
+       p = (const uint8_t *)pg_round_down(p) + PGSIZE) {
+    if (!vm_pin_page(p, write)) {
+      if (p != first) vm_unpin_buffer(first, p - first);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* vm_pin_buffer()로 고정한 버퍼의 페이지들을 모두 풀어 준다. */
+void vm_unpin_buffer(const void *buffer, size_t size) {
+  const uint8_t *first = buffer;
+  const uint8_t *last = first + size - 1;
+
+  if (size == 0) return;
+  for (const uint8_t *p = pg_round_down(first); p <= last; p += PGSIZE)
+    vm_unpin_page(p);
+}
+
 /* Initialize new supplemental page table */
 void supplemental_page_table_init(struct supplemental_page_table *spt UNUSED) {
   hash_init(&spt->spt_hash, page_hash, page_less, NULL);  // spt 초기화